@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Define the size of the blocks (bigger allocations get their own block) and
+// the alignment of the allocations
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+
+// ===== Structure definitions =====
+
+// --- Structure to contain a block of the arena, the memory follows the header
+typedef struct _arena_block {
+    struct _arena_block *next;
+    size_t size;
+    size_t used;
+} arena_block;
+
+// --- Structure to contain a bump-pointer arena, all its memory is released at once
+typedef struct {
+    arena_block *head;
+} arena_t;
+
+
+// ===== Exported function definitions =====
+
+void arena_init(arena_t *arena);
+void *arena_alloc(arena_t *arena, size_t size);
+char *arena_strdup(arena_t *arena, const char *str);
+void arena_release(arena_t *arena);
+
+
+#endif
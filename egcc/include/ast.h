@@ -1,6 +1,8 @@
 #ifndef AST_H
 #define AST_H
 
+#include "arena.h"
+
 
 // ===== Structure definitions =====
 
@@ -155,6 +157,9 @@ struct _unop {
 
 // ===== Exported function definitions =====
 
+void set_ast_arena(arena_t *arena);
+char *new_name(const char *name);
+
 AST_Prog new_prog(AST_Stmts stmts);
 
 AST_Stmt new_let_stmt(char *ident, AST_Expr expr);
@@ -181,7 +186,5 @@ AST_Args add_arg(AST_Args args, AST_Expr arg);
 
 AST_Params add_param(AST_Params params, char *param);
 
-void clean_ast(AST_Prog prog);
-
 
 #endif
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef AST_OPTIMIZER_H
+#define AST_OPTIMIZER_H
+
+#include "ast.h"
+
+
+// ===== Exported function definitions =====
+
+void optimize_ast(AST_Prog prog);
+
+
+#endif
@@ -2,14 +2,27 @@
 #define COMPILER_H
 
 #include "ast.h"
+#include "arena.h"
 #include "main.h"
 
+#define ACC 0   // Accumulator / Return register
+#define SA 1    // Stack Adress register
+#define SP 2    // Stack Pointer register
+#define ZERO 3  // Zero register, contains value 0 between the expressions (table of the jumps)
+#define TMP2 4  // Temporary 2 register
+#define TMP3 5  // Temporary 3 register
+#define ONE 6   // One register, contains value 1
+#define MO 7    // Minus One register, contains value -1
+
+#define EXPR_REG_NUMBER 4   // Number of registers to compute the expressions (ACC, the temporaries and ZERO)
+
 
 // ===== Structure definitions =====
 
 // --- Structure to contain all compiler's configuration
 typedef struct {
     unsigned int flags;
+    unsigned int opt_level;
     char *input_file_name;
     FILE *input_file;
     char *output_file_name;
@@ -55,11 +68,15 @@ typedef struct {
 typedef struct {
     compiler_settings_t *settings;
     compiler_error_t *error;
+    arena_t *arena;
     labeled_instruction **lbl_instr_arr;
     unsigned int arr_size;
     unsigned int arr_offset;
     int *lbl_adress_arr;
+    int *lbl_alias_arr;
+    unsigned int alias_size;
     int nb_lbl;
+    int pending_lbl;
 } compiler_data_t;
 
 
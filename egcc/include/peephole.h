@@ -0,0 +1,39 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "compiler.h"
+
+// Define the maximal number of passes and the search windows
+#define PEEPHOLE_MAX_PASSES 8
+#define PEEPHOLE_PUSH_WINDOW 16
+#define PEEPHOLE_LIVE_WINDOW 64
+#define PEEPHOLE_MAX_HOPS 16
+
+
+// ===== Structure definitions =====
+
+// --- Structure to contain the known value of a register in a basic block
+typedef struct {
+    enum {UNKNOWN_VAL, INT_VAL, LABEL_VAL} val_type;
+    int val;
+} known_value;
+
+// --- Structure to contain the statistics of the peephole optimizer
+typedef struct {
+    unsigned int initial_size;
+    unsigned int final_size;
+    unsigned int passes;
+    unsigned int push_pop;
+    unsigned int ortho;
+    unsigned int jump_next;
+    unsigned int jump_thread;
+} peephole_stats_t;
+
+
+// ===== Exported function definitions =====
+
+void peephole_optimize(compiler_data_t *data, peephole_stats_t *stats);
+void print_peephole_stats(peephole_stats_t *stats);
+
+
+#endif
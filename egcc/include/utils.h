@@ -7,6 +7,7 @@
 char **str_split(char *str, char delimiter);
 char *change_extension(char *file_name, char *new_extension);
 int reverse(int to_reverse);
+void reverse_buffer(unsigned int *dst, const unsigned int *src, unsigned int size);
 
 
 #endif
\ No newline at end of file
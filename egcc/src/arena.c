@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+
+// ===== Internal functions for the arena =====
+
+// --- Round a size up to the alignment of the allocations
+static size_t _align(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+// --- Add a new block at the head of the arena
+static arena_block * _new_block(arena_t *arena, size_t size) {
+    arena_block *block = (arena_block *) malloc(_align(sizeof(arena_block)) + size);
+    block->next = arena->head;
+    block->size = size;
+    block->used = 0;
+    arena->head = block;
+    return block;
+}
+
+
+// ===== Functions to manage the arena =====
+
+// The nodes of the AST and the instructions are small and many, and they all
+// live until the end of the compilation : they are bumped in big blocks
+// instead of being malloced one by one, and nothing is freed individually
+
+// --- Initialize an empty arena
+void arena_init(arena_t *arena) {
+    arena->head = NULL;
+}
+
+// --- Allocate memory in the arena
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = _align(size);
+
+    // Open a new block if the current one is full, the rest of it is lost
+    arena_block *block = arena->head;
+    if(block == NULL || block->size - block->used < size) {
+        block = _new_block(arena, size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+    }
+
+    void *res = (char *) block + _align(sizeof(arena_block)) + block->used;
+    block->used += size;
+    return res;
+}
+
+// --- Copy a string in the arena
+char *arena_strdup(arena_t *arena, const char *str) {
+    size_t size = strlen(str) + 1;
+    char *res = (char *) arena_alloc(arena, size);
+    memcpy(res, str, size);
+    return res;
+}
+
+// --- Release all the memory of the arena
+void arena_release(arena_t *arena) {
+    arena_block *block = arena->head;
+    while(block != NULL) {
+        arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
@@ -0,0 +1,305 @@
+#include "ast_optimizer.h"
+#include "ast.h"
+
+
+// ===== Internal function declarations =====
+
+static int _is_int(AST_Expr expr, int value);
+static int _is_pure(AST_Expr expr);
+static AST_Expr _new_int(AST_Expr expr, int value);
+
+static void _optimize_stmt(AST_Stmt stmt);
+static void _optimize_stmts(AST_Stmts stmts);
+static AST_Stmts _splice_branch(AST_Stmts node, AST_Stmts branch);
+static AST_Expr _optimize_expr(AST_Expr expr);
+static void _optimize_args(AST_Args args);
+static AST_Expr _optimize_binop(AST_Expr expr);
+static AST_Expr _optimize_unop(AST_Expr expr);
+
+
+// ===== Functions to optimize the AST before the compilation =====
+
+// The AST is simplified in place between the parsing and the compilation, the
+// removed nodes are left in the arena of the compilation :
+// - the constant expressions are folded with the UM semantics (32 bits wrapping
+//   arithmetic, unsigned division, bitwise logical operators) except the
+//   divisions by 0 which are kept for the runtime error
+// - the identities (x + 0, x - 0, x * 1, x / 1, x || 0, !!x, - -x) are reduced
+//   to x, and x * 0 or x && 0 to 0 if x has no side effect
+// - the parentheses are removed, they only drive the parsing
+// - an if with a constant condition is replaced by the kept branch and a while
+//   with a false constant condition is removed
+
+// --- Test if an expression is the wanted integer constant
+static int _is_int(AST_Expr expr, int value) {
+    return expr->expr_type == INT_EXPR && expr->content.int_expr == value;
+}
+
+// --- Test if an expression can be removed without changing the program (no call
+// and no division which can fail)
+static int _is_pure(AST_Expr expr) {
+    switch (expr->expr_type) {
+
+    case INT_EXPR:
+    case STRING_EXPR:
+    case IDENT_EXPR:
+        return 1;
+
+    case PAREN_EXPR:
+        return _is_pure(expr->content.paren_expr);
+
+    case BINOP_EXPR:
+        if(expr->content.binop_expr->binop_type == DIVIDE || expr->content.binop_expr->binop_type == PERCENT) {
+            return 0;
+        }
+        return _is_pure(expr->content.binop_expr->left) && _is_pure(expr->content.binop_expr->right);
+
+    case UNOP_EXPR:
+        return _is_pure(expr->content.unop_expr->expr);
+
+    default:
+        return 0;
+
+    }
+}
+
+// --- Replace an operation by an integer constant
+static AST_Expr _new_int(AST_Expr expr, int value) {
+    expr->expr_type = INT_EXPR;
+    expr->content.int_expr = value;
+    return expr;
+}
+
+// --- Optimize a statement
+static void _optimize_stmt(AST_Stmt stmt) {
+    switch (stmt->stmt_type) {
+
+    case LET_STMT:
+        stmt->content.let_stmt.expr = _optimize_expr(stmt->content.let_stmt.expr);
+        break;
+
+    case AFFECT_STMT:
+        stmt->content.affect_stmt.expr = _optimize_expr(stmt->content.affect_stmt.expr);
+        break;
+
+    case FUN_STMT:
+        _optimize_stmts(stmt->content.fun_stmt.body);
+        break;
+
+    case IF_STMT:
+        stmt->content.if_stmt.cond = _optimize_expr(stmt->content.if_stmt.cond);
+        _optimize_stmts(stmt->content.if_stmt.conseq);
+        _optimize_stmts(stmt->content.if_stmt.altern);
+        break;
+
+    case WHILE_STMT:
+        stmt->content.while_stmt.cond = _optimize_expr(stmt->content.while_stmt.cond);
+        _optimize_stmts(stmt->content.while_stmt.body);
+        break;
+
+    case FOR_STMT:
+        if(stmt->content.for_stmt.init != NULL) {
+            _optimize_stmt(stmt->content.for_stmt.init);
+        }
+        stmt->content.for_stmt.cond = _optimize_expr(stmt->content.for_stmt.cond);
+        if(stmt->content.for_stmt.update != NULL) {
+            _optimize_stmt(stmt->content.for_stmt.update);
+        }
+        _optimize_stmts(stmt->content.for_stmt.body);
+        break;
+
+    case RETURN_STMT:
+        stmt->content.return_stmt = _optimize_expr(stmt->content.return_stmt);
+        break;
+
+    default:
+        break;
+
+    }
+}
+
+// --- Optimize many statements, remove the dead branches
+static void _optimize_stmts(AST_Stmts stmts) {
+    for(AST_Stmts node = stmts ; node != NULL ; node = node->tail) {
+        AST_Stmt stmt = node->head;
+        if(stmt == NULL) {
+            continue;
+        }
+        _optimize_stmt(stmt);
+
+        // Keep only the taken branch of an if with a constant condition
+        if(stmt->stmt_type == IF_STMT && stmt->content.if_stmt.cond->expr_type == INT_EXPR) {
+            AST_Stmts kept = stmt->content.if_stmt.conseq;
+            if(stmt->content.if_stmt.cond->content.int_expr == 0) {
+                kept = stmt->content.if_stmt.altern;
+            }
+            node = _splice_branch(node, kept);
+        } else
+
+        // Remove a while which is never entered
+        if(stmt->stmt_type == WHILE_STMT && _is_int(stmt->content.while_stmt.cond, 0)) {
+            node->head = NULL;
+        }
+    }
+}
+
+// --- Replace the statement of a list node by a branch (NULL for nothing) and
+// return the last node of the inserted statements
+static AST_Stmts _splice_branch(AST_Stmts node, AST_Stmts branch) {
+    node->head = NULL;
+    if(branch == NULL) {
+        return node;
+    }
+
+    // Link the end of the branch to the rest of the list
+    AST_Stmts last = branch;
+    while(last->tail != NULL) {
+        last = last->tail;
+    }
+    last->tail = node->tail;
+
+    // Move the branch head in the node to keep the list links
+    node->head = branch->head;
+    node->tail = branch->tail;
+    if(last == branch) {
+        last = node;
+    }
+
+    return last;
+}
+
+// --- Optimize an expression and return the expression to use instead
+static AST_Expr _optimize_expr(AST_Expr expr) {
+    switch (expr->expr_type) {
+
+    case PAREN_EXPR:
+        return _optimize_expr(expr->content.paren_expr);
+
+    case BINOP_EXPR:
+        return _optimize_binop(expr);
+
+    case UNOP_EXPR:
+        return _optimize_unop(expr);
+
+    case APP_EXPR:
+        expr->content.app_expr.expr = _optimize_expr(expr->content.app_expr.expr);
+        _optimize_args(expr->content.app_expr.args);
+        return expr;
+
+    case LAMBDA_EXPR:
+        _optimize_stmts(expr->content.lambda_expr->body);
+        return expr;
+
+    default:
+        return expr;
+
+    }
+}
+
+// --- Optimize some arguments
+static void _optimize_args(AST_Args args) {
+    for(AST_Args node = args ; node != NULL ; node = node->tail) {
+        if(node->head != NULL) {
+            node->head = _optimize_expr(node->head);
+        }
+    }
+}
+
+// --- Optimize a binary operation
+static AST_Expr _optimize_binop(AST_Expr expr) {
+    AST_Binop binop = expr->content.binop_expr;
+    binop->left = _optimize_expr(binop->left);
+    binop->right = _optimize_expr(binop->right);
+    AST_Expr left = binop->left;
+    AST_Expr right = binop->right;
+
+    // Fold the constant operations
+    if(left->expr_type == INT_EXPR && right->expr_type == INT_EXPR) {
+        unsigned int x = (unsigned int) left->content.int_expr;
+        unsigned int y = (unsigned int) right->content.int_expr;
+
+        switch (binop->binop_type) {
+
+        case PLUS:      return _new_int(expr, (int) (x + y));
+        case MINUS:     return _new_int(expr, (int) (x - y));
+        case TIMES:     return _new_int(expr, (int) (x * y));
+        case DIVIDE:    return y != 0 ? _new_int(expr, (int) (x / y)) : expr;
+        case PERCENT:   return y != 0 ? _new_int(expr, (int) (x % y)) : expr;
+        case EQEQ:      return _new_int(expr, x == y);
+        case LTEQ:      return _new_int(expr, (int) x <= (int) y);
+        case GTEQ:      return _new_int(expr, (int) x >= (int) y);
+        case LT:        return _new_int(expr, (int) x < (int) y);
+        case GT:        return _new_int(expr, (int) x > (int) y);
+        case AND:       return _new_int(expr, (int) (x & y));
+        case OR:        return _new_int(expr, (int) (x | y));
+        default:        return expr;
+
+        }
+    }
+
+    // Reduce the identities
+    switch (binop->binop_type) {
+
+    case PLUS:
+    case OR:
+        if(_is_int(right, 0)) return left;
+        if(_is_int(left, 0)) return right;
+        break;
+
+    case MINUS:
+        if(_is_int(right, 0)) return left;
+        break;
+
+    case TIMES:
+        if(_is_int(right, 1)) return left;
+        if(_is_int(left, 1)) return right;
+        if((_is_int(right, 0) && _is_pure(left)) || (_is_int(left, 0) && _is_pure(right))) return _new_int(expr, 0);
+        break;
+
+    case AND:
+        if((_is_int(right, 0) && _is_pure(left)) || (_is_int(left, 0) && _is_pure(right))) return _new_int(expr, 0);
+        break;
+
+    case DIVIDE:
+        if(_is_int(right, 1)) return left;
+        break;
+
+    default:
+        break;
+
+    }
+
+    return expr;
+}
+
+// --- Optimize an unary operation
+static AST_Expr _optimize_unop(AST_Expr expr) {
+    AST_Unop unop = expr->content.unop_expr;
+    unop->expr = _optimize_expr(unop->expr);
+    AST_Expr operand = unop->expr;
+
+    // Fold the constant operations
+    if(operand->expr_type == INT_EXPR) {
+        unsigned int x = (unsigned int) operand->content.int_expr;
+
+        switch (unop->unop_type) {
+
+        case NEGATE:    return _new_int(expr, (int) -x);
+        case NOT:       return _new_int(expr, (int) ~x);
+        default:        return expr;
+
+        }
+    }
+
+    // Reduce the double negations (both operators are involutions)
+    if(operand->expr_type == UNOP_EXPR && operand->content.unop_expr->unop_type == unop->unop_type && unop->unop_type != UN_UNKNOWN) {
+        return operand->content.unop_expr->expr;
+    }
+
+    return expr;
+}
+
+// --- Optimize the full program in place
+void optimize_ast(AST_Prog prog) {
+    _optimize_stmts(prog->stmts);
+}
@@ -16,6 +16,7 @@ static void _print_lambda(AST_Lambda lambda);
 static void _print_args(AST_Args args);
 static void _print_params(AST_Params params);
 static void _print_binop(AST_Binop binop);
+static void _print_operand(AST_Expr expr);
 static void _print_unop(AST_Unop unop);
 
 
@@ -255,7 +256,7 @@ static void _print_params(AST_Params params) {
 // --- Print a binary operation
 static void _print_binop(AST_Binop binop) {
 
-    _print_expr(binop->left);
+    _print_operand(binop->left);
 
     switch (binop->binop_type) {
 
@@ -313,10 +314,22 @@ static void _print_binop(AST_Binop binop) {
 
     }
 
-    _print_expr(binop->right);
+    _print_operand(binop->right);
 
 }
 
+// --- Print the operand of an operation, the nested operations are in parentheses
+// since the optimizer removes the parentheses of the source
+static void _print_operand(AST_Expr expr) {
+    if(expr->expr_type == BINOP_EXPR) {
+        printf("(");
+        _print_expr(expr);
+        printf(")");
+    } else {
+        _print_expr(expr);
+    }
+}
+
 // --- Print an unary operation
 static void _print_unop(AST_Unop unop) {
 
@@ -336,7 +349,7 @@ static void _print_unop(AST_Unop unop) {
 
     }
 
-    _print_expr(unop->expr);
+    _print_operand(unop->expr);
     
 }
 
@@ -1,20 +1,20 @@
+#include <stdlib.h>
+
 #include "compiler.h"
+#include "arena.h"
 #include "utils.h"
 #include "main.h"
-
-#define ACC 0   // Accumulator / Return register
-#define SA 1    // Stack Adress register
-#define SP 2    // Stack Pointer register
-#define TMP1 3  // Temporary 1 register
-#define TMP2 4  // Temporary 2 register
-#define TMP3 5  // Temporary 3 register
-#define ONE 6   // One register, contains value 1
-#define MO 7    // Minus One register, contains value -1
+#include "peephole.h"
 
 
 // ===== Internal function declarations =====
 
 
+static void _ortho(compiler_data_t *data, int a, int value, char val_is_target_lbl, int label);
+static int _place_label(compiler_data_t *data, int label);
+static void _resolve_label_aliases(compiler_data_t *data);
+static void _jump(compiler_data_t *data, int label);
+static void _branch(compiler_data_t *data, int lbl_true, int lbl_false);
 static void _push(int register_src, compiler_data_t *data);
 static void _pop(int register_dst, compiler_data_t *data);
 
@@ -22,11 +22,22 @@ static void _compile_prog(AST_Prog prog, compiler_data_t *data);
 static void _compile_stmt(AST_Stmt stmt, compiler_data_t *data);
 static void _compile_stmts(AST_Stmts stmts, compiler_data_t *data);
 static void _compile_expr(AST_Expr expr, compiler_data_t *data);
+static int _register_need(AST_Expr expr);
+static int _binop_register_need(AST_Binop binop);
+static void _compile_expr_in(AST_Expr expr, const int *regs, int nb_regs, compiler_data_t *data);
 static void _print_lambda(AST_Lambda lambda, compiler_data_t *data);
 static void _print_args(AST_Args args, compiler_data_t *data);
 static void _print_params(AST_Params params, compiler_data_t *data);
-static void _compile_binop(AST_Binop binop, compiler_data_t *data);
-static void _compile_unop(AST_Unop unop, compiler_data_t *data);
+static int _compile_test(AST_Expr expr, compiler_data_t *data);
+static int _compile_binop(AST_Binop binop, const int *regs, int nb_regs, int as_test, compiler_data_t *data);
+static void _less_than(compiler_data_t *data, int r, int x, int y, int s, int t, int negate, int as_test);
+static void _compile_unop(AST_Unop unop, const int *regs, int nb_regs, compiler_data_t *data);
+
+
+// ===== Global variables =====
+
+// The registers available to compute an expression, the result ends in the first one
+static const int expr_regs[EXPR_REG_NUMBER] = {ACC, TMP2, TMP3, ZERO};
 
 
 // ===== Primitives =====
@@ -40,33 +51,29 @@ static void _print_int(int x) {
 // ===== Functions to write in the file =====
 
 
-static void _write_int(compiler_data_t *data, int x) {
-    x = reverse(x); // Reverse the endianess
-    fwrite(&x, sizeof(int), 1, data->settings->output_file);
-}
-
-static void _write_std_op(compiler_data_t *data, int opcode, int a, int b, int c) {
-    int op = (opcode << 28) | ((a << 6) | (b << 3) | c);
-    _write_int(data, op);
+static int _encode_std_op(int opcode, int a, int b, int c) {
+    return (opcode << 28) | ((a << 6) | (b << 3) | c);
 }
 
-static void _write_ortho_op(compiler_data_t *data, int a, int value) {
-    int op = (13 << 28) | ((a << 25) | value);
-    _write_int(data, op);
+static int _encode_ortho_op(int a, int value) {
+    return (13 << 28) | ((a << 25) | value);
 }
 
 
 // --- Generate bytecode from the labeled instructions array and from the label-adress array
 static void _generate_bytecode(compiler_data_t *data) {
 
-    for (int i = 0; i < data->arr_size; i++) {
+    // The whole bytecode is encoded in a buffer, reversed and written at once
+    unsigned int *buffer = (unsigned int *) malloc(data->arr_offset * sizeof(int));
+
+    for (int i = 0; i < data->arr_offset; i++) {
 
         instruction *instr = data->lbl_instr_arr[i]->instr;
         
         switch (instr->op_type) {
         
         case STD_OP:
-            _write_std_op(data, instr->content.std_op.opcode, instr->content.std_op.a, instr->content.std_op.b, instr->content.std_op.c);
+            buffer[i] = _encode_std_op(instr->content.std_op.opcode, instr->content.std_op.a, instr->content.std_op.b, instr->content.std_op.c);
             break;
 
         case ORTHO_OP:
@@ -75,13 +82,13 @@ static void _generate_bytecode(compiler_data_t *data) {
                 // Replace the label name by its adress value
                 instr->content.ortho_op.val = data->lbl_adress_arr[instr->content.ortho_op.val];
             }
-            // Send it to the writter
-            _write_ortho_op(data, instr->content.ortho_op.a, instr->content.ortho_op.val);
+            // Send it to the encoder
+            buffer[i] = _encode_ortho_op(instr->content.ortho_op.a, instr->content.ortho_op.val);
             break;
 
         case BIGINT:
-            // Send it to the writter 
-            _write_int(data, instr->content.big_int);
+            // Send it to the buffer
+            buffer[i] = instr->content.big_int;
             break;
         
         default:
@@ -89,6 +96,11 @@ static void _generate_bytecode(compiler_data_t *data) {
         }       
 
     }
+
+    // Reverse the endianess and write the buffer in the file
+    reverse_buffer(buffer, buffer, data->arr_offset);
+    fwrite(buffer, sizeof(int), data->arr_offset, data->settings->output_file);
+    free(buffer);
 }
 
 
@@ -96,7 +108,7 @@ static void _generate_bytecode(compiler_data_t *data) {
 
 
 static void _link_labels(compiler_data_t *data) {
-    for (int i = 0; i < data->arr_size; i++) {
+    for (int i = 0; i < data->arr_offset; i++) {
         int label = data->lbl_instr_arr[i]->label;
         if (label != -1) {
             // The line is labeled so we store the label and the line number
@@ -111,13 +123,25 @@ static void _link_labels(compiler_data_t *data) {
 
 // --- Add a labeled instruction (created from the instruction given as a parameter) in the lbl_instr_arr
 static void _add_lbl_instr(compiler_data_t *data, instruction *instr, int label) {
+    // Put the label placed before on this instruction (or on a carrier if it
+    // already has one)
+    if(data->pending_lbl != -1) {
+        int pending = data->pending_lbl;
+        data->pending_lbl = -1;
+        if(label == -1) {
+            label = pending;
+        } else {
+            _ortho(data, ZERO, 0, 0, pending);
+        }
+    }
+
     // Testing the array's capacity 
     if(data->arr_offset >= data->arr_size) {
         data->arr_size = data->arr_size * 2;
         data->lbl_instr_arr = (labeled_instruction **) realloc(data->lbl_instr_arr, data->arr_size * sizeof(labeled_instruction *));
     }
     // Create and add the labeled instruction to the array
-    labeled_instruction *lbl_instr = (labeled_instruction *) malloc(sizeof(labeled_instruction));
+    labeled_instruction *lbl_instr = (labeled_instruction *) arena_alloc(data->arena, sizeof(labeled_instruction));
     lbl_instr->instr = instr;
     lbl_instr->label = label;
     data->lbl_instr_arr[data->arr_offset] = lbl_instr;
@@ -127,7 +151,7 @@ static void _add_lbl_instr(compiler_data_t *data, instruction *instr, int label)
 // --- Create an instruction from an opcode int, and 3 integers (register numbers) 
 static instruction * _create_std_instr(compiler_data_t *data, int opcode, int a, int b, int c) {
     // Construct the new instruction
-    instruction *instr = (instruction *) malloc(sizeof(instruction));
+    instruction *instr = (instruction *) arena_alloc(data->arena, sizeof(instruction));
     instr->op_type = STD_OP;
     instr->content.std_op.opcode = opcode;
     instr->content.std_op.a = a;
@@ -154,7 +178,7 @@ static void _load_prog(compiler_data_t *data, int b, int c, int label)
 // --- Special instructions
 static void _ortho(compiler_data_t *data, int a, int value, char val_is_target_lbl, int label) {
     // Only the ORTHO operators can take as value an int or a target label.
-    instruction *instr = (instruction *) malloc(sizeof(instruction));
+    instruction *instr = (instruction *) arena_alloc(data->arena, sizeof(instruction));
     instr->op_type = ORTHO_OP;
     instr->content.ortho_op.opcode = 13;
     instr->content.ortho_op.a = a;
@@ -164,7 +188,7 @@ static void _ortho(compiler_data_t *data, int a, int value, char val_is_target_l
 }
 
 static void _bigint(compiler_data_t *data, int value, int label) {
-    instruction *instr = (instruction *) malloc(sizeof(instruction));
+    instruction *instr = (instruction *) arena_alloc(data->arena, sizeof(instruction));
     instr->op_type = BIGINT;
     instr->content.big_int = value;
     _add_lbl_instr(data, instr, label);
@@ -186,6 +210,57 @@ static void _pop(int register_dst, compiler_data_t *data) {
     _array_index(data, register_dst, SA, SP, -1);
 }
 
+// --- Place a label on the next instruction and return the label to use for it
+// (the one already placed there if any, the new one becomes its alias and its
+// loads are replaced once the whole program is compiled)
+static int _place_label(compiler_data_t *data, int label) {
+    if(data->pending_lbl == -1) {
+        data->pending_lbl = label;
+        return label;
+    }
+
+    // Testing the alias array's capacity
+    if((unsigned int) label >= data->alias_size) {
+        unsigned int old_size = data->alias_size;
+        while((unsigned int) label >= data->alias_size) {
+            data->alias_size = data->alias_size * 2;
+        }
+        data->lbl_alias_arr = (int *) realloc(data->lbl_alias_arr, data->alias_size * sizeof(int));
+        for(unsigned int i = old_size ; i < data->alias_size ; i++) {
+            data->lbl_alias_arr[i] = -1;
+        }
+    }
+    data->lbl_alias_arr[label] = data->pending_lbl;
+    return data->pending_lbl;
+}
+
+// --- Replace the loads of the aliased labels by the loads of the labels they
+// share an instruction with (an aliased label is never placed, so its target is
+// never aliased)
+static void _resolve_label_aliases(compiler_data_t *data) {
+    for(unsigned int i = 0 ; i < data->arr_offset ; i++) {
+        instruction *instr = data->lbl_instr_arr[i]->instr;
+        if(instr->op_type == ORTHO_OP && instr->content.ortho_op.val_is_target_lbl
+            && (unsigned int) instr->content.ortho_op.val < data->alias_size && data->lbl_alias_arr[instr->content.ortho_op.val] != -1) {
+            instr->content.ortho_op.val = data->lbl_alias_arr[instr->content.ortho_op.val];
+        }
+    }
+}
+
+// --- Jump to a label (ZERO is the table 0 index)
+static void _jump(compiler_data_t *data, int label) {
+    _ortho(data, TMP2, label, 1, -1);
+    _load_prog(data, ZERO, TMP2, -1);
+}
+
+// --- Jump to a label if ACC is true (!=0), else to another one
+static void _branch(compiler_data_t *data, int lbl_true, int lbl_false) {
+    _ortho(data, TMP2, lbl_true, 1, -1);
+    _ortho(data, TMP3, lbl_false, 1, -1);
+    _cond_move(data, TMP3, TMP2, ACC, -1);
+    _load_prog(data, ZERO, TMP3, -1);
+}
+
 
 // --- Compile a program
 static void _compile_prog(AST_Prog prog, compiler_data_t *data) {
@@ -196,7 +271,7 @@ static void _compile_prog(AST_Prog prog, compiler_data_t *data) {
 // --- Compile a statement
 static void _compile_stmt(AST_Stmt stmt, compiler_data_t *data) {
 
-    int lbl_x, lbl_y, lbl_z;
+    int lbl_x, lbl_y, lbl_z, negated;
 
     switch (stmt->stmt_type) {
 
@@ -215,44 +290,39 @@ static void _compile_stmt(AST_Stmt stmt, compiler_data_t *data) {
         break;
 
     case IF_STMT:
-        // Compilation of the condition expression
-        _compile_expr(stmt->content.if_stmt.cond, data);
+        // Compilation of the condition expression (maybe negated)
+        negated = _compile_test(stmt->content.if_stmt.cond, data);
 
         lbl_x = data->nb_lbl++; // then_lbl
         lbl_y = data->nb_lbl++; // else_lbl
         lbl_z = data->nb_lbl++; // endif_lbl
+        if(stmt->content.if_stmt.altern == NULL) {
+            lbl_y = lbl_z;
+        }
 
-        // Load the then & else labels
-        _ortho(data, TMP2, lbl_x, 1, -1);
-        _ortho(data, TMP3, lbl_y, 1, -1);
-
-        // We will load the program at line TMP3 (jump TMP3)
-        // So we need to put TMP2 in TMP3 if ACC is true (!=0)
-        // This way, TMP3 = lbl_then if ACC is true, and else TMP3 = lbl_else
-        _cond_move(data, TMP3, TMP2, ACC, -1);
-        // Jump/Loading :
-        _ortho(data, TMP1, 0, 0, -1);
-        _load_prog(data, TMP1, TMP3, -1);
+        // The consequence follows the test, so the jump goes to lbl_then (the next
+        // instruction) if the condition is true, else to lbl_else
+        if(negated) {
+            _branch(data, lbl_y, lbl_x);
+        } else {
+            _branch(data, lbl_x, lbl_y);
+        }
 
         // --- lbl_then :
-        // Labelise
-        _ortho(data, TMP1, 0, 0, lbl_x);
+        _place_label(data, lbl_x);
         // Compile if's consequence
         _compile_stmts(stmt->content.if_stmt.conseq, data);
-        // and we jump at lbl_endif so we avoid the else part
-        _ortho(data, TMP1, 0, 0, -1);
-        _ortho(data, TMP2, lbl_z, 1, -1);
-        _load_prog(data, TMP1, TMP2, -1);
 
         // --- lbl_else :
-        // Labelise
-        _ortho(data, TMP1, 0, 0, lbl_y); 
-        // Compile if's alternative
-        _compile_stmts(stmt->content.if_stmt.altern, data);
-
-        // --- lbl_endif : 
-        // Nothing more to do, except labelising the next instruction
-        _ortho(data, TMP1, 0, 0, lbl_z);
+        // Only if there is an alternative, we jump at lbl_endif so we avoid it
+        if(stmt->content.if_stmt.altern != NULL) {
+            _jump(data, lbl_z);
+            _place_label(data, lbl_y);
+            _compile_stmts(stmt->content.if_stmt.altern, data);
+        }
+
+        // --- lbl_endif :
+        _place_label(data, lbl_z);
         break;
 
     case WHILE_STMT:
@@ -260,33 +330,29 @@ static void _compile_stmt(AST_Stmt stmt, compiler_data_t *data) {
         lbl_y = data->nb_lbl++; // while_body
         lbl_z = data->nb_lbl++; // while_end
 
-        // --- lbl_while_cond :
-        // Labelise
-        _ortho(data, TMP1, 0, 0, lbl_x);
-        // Compilation of the condition expression
-        _compile_expr(stmt->content.while_stmt.cond, data);
-        // Load the body & end labels
-        _ortho(data, TMP2, lbl_z, 1, -1);
-        _ortho(data, TMP3, lbl_y, 1, -1);
-        // Test the result of the condition
-        _cond_move(data, TMP2, TMP3, ACC, -1);
-        // Jump/Loading
-        _ortho(data, TMP1, 0, 0, -1);
-        _load_prog(data, TMP1, TMP2, -1);
+        // The condition is placed after the body, so an iteration only does one
+        // jump (the conditional one going back to the body or to lbl_while_end
+        // right after it) and the first test is reached with a single jump
+        _jump(data, lbl_x);
 
         // --- lbl_while_body :
-        // Labelise
-        _ortho(data, TMP1, 0, 0, lbl_y);
+        lbl_y = _place_label(data, lbl_y);
         // Compilation of the body expression
         _compile_stmts(stmt->content.while_stmt.body, data);
-        // Jump back to the condition
-        _ortho(data, TMP1, 0, 0, -1);
-        _ortho(data, TMP2, lbl_x, 1, -1);
-        _load_prog(data, TMP1, TMP2, -1);
+
+        // --- lbl_while_cond :
+        _place_label(data, lbl_x);
+        // Compilation of the condition expression (maybe negated)
+        negated = _compile_test(stmt->content.while_stmt.cond, data);
+        // Jump to the body if the condition is true, else to the end
+        if(negated) {
+            _branch(data, lbl_z, lbl_y);
+        } else {
+            _branch(data, lbl_y, lbl_z);
+        }
 
         // --- lbl_while_end :
-        // Labelise
-        _ortho(data, TMP1, 0, 0, lbl_z);
+        _place_label(data, lbl_z);
         break;
 
     case FOR_STMT:
@@ -312,6 +378,10 @@ static void _compile_stmt(AST_Stmt stmt, compiler_data_t *data) {
 
 // --- Compile many statements
 static void _compile_stmts(AST_Stmts stmts, compiler_data_t *data) {
+    if(stmts == NULL) {
+        return;
+    }
+
     if(stmts->head != NULL) {
         _compile_stmt(stmts->head, data);
     }
@@ -322,31 +392,111 @@ static void _compile_stmts(AST_Stmts stmts, compiler_data_t *data) {
 }
 
 
-// --- Compile an expression
+// --- Compile an expression in the accumulator (ZERO is the last register used and
+// is cleared after the expressions needing it)
 static void _compile_expr(AST_Expr expr, compiler_data_t *data) {
+    _compile_expr_in(expr, expr_regs, EXPR_REG_NUMBER, data);
+    if(_register_need(expr) >= EXPR_REG_NUMBER) {
+        _ortho(data, ZERO, 0, 0, -1);
+    }
+}
+
+// --- Compile a condition in the accumulator for a branch and return 1 if ACC is
+// true (!=0) when the condition is false : the comparisons are not turned into
+// 0 or 1 when the raw value is enough to branch
+static int _compile_test(AST_Expr expr, compiler_data_t *data) {
+    int negated;
+
+    while(expr->expr_type == PAREN_EXPR) {
+        expr = expr->content.paren_expr;
+    }
+    if(expr->expr_type != BINOP_EXPR) {
+        _compile_expr(expr, data);
+        return 0;
+    }
+
+    negated = _compile_binop(expr->content.binop_expr, expr_regs, EXPR_REG_NUMBER, 1, data);
+    if(_register_need(expr) >= EXPR_REG_NUMBER) {
+        _ortho(data, ZERO, 0, 0, -1);
+    }
+    return negated;
+}
+
+// --- Get the number of registers needed to compute an expression without spilling
+// (Sethi-Ullman numbering, the uncompiled expressions take all the registers)
+static int _register_need(AST_Expr expr) {
+    int left, right, need;
+
+    switch (expr->expr_type) {
+
+    case INT_EXPR:
+        // A bigint needs a second register to hold the table 0 index
+        return (unsigned int) expr->content.int_expr < 33554432 ? 1 : 2;
+
+    case PAREN_EXPR:
+        return _register_need(expr->content.paren_expr);
+
+    case UNOP_EXPR:
+        return _register_need(expr->content.unop_expr->expr);
+
+    case BINOP_EXPR:
+        left = _register_need(expr->content.binop_expr->left);
+        right = _register_need(expr->content.binop_expr->right);
+        need = left == right ? left + 1 : (left > right ? left : right);
+        return need > _binop_register_need(expr->content.binop_expr) ? need : _binop_register_need(expr->content.binop_expr);
+
+    default:
+        return EXPR_REG_NUMBER;
+
+    }
+}
+
+// --- Get the number of registers used by the operation itself (both operands and the scratches)
+static int _binop_register_need(AST_Binop binop) {
+    switch (binop->binop_type) {
+
+    case LT:
+    case GT:
+    case LTEQ:
+    case GTEQ:
+        return 4;
+
+    case PERCENT:
+    case EQEQ:
+        return 3;
+
+    default:
+        return 2;
+
+    }
+}
+
+// --- Compile an expression in regs[0], using only the nb_regs registers of regs
+static void _compile_expr_in(AST_Expr expr, const int *regs, int nb_regs, compiler_data_t *data) {
 
     switch (expr->expr_type) {
 
     int lbl_x, lbl_y;
 
     case INT_EXPR:
-        // The max integer value for ORTHO instruction should be encodable on 25 bits :
-        if (expr->content.int_expr < 33554432) {
+        // The max integer value for ORTHO instruction should be encodable on 25 bits (the negative
+        // values coming from the constant folding are not) :
+        if ((unsigned int) expr->content.int_expr < 33554432) {
             // It is encodable on 25 bits
-            _ortho(data, ACC, expr->content.int_expr, 0, -1);
+            _ortho(data, regs[0], expr->content.int_expr, 0, -1);
         } else {
             // It is not encodable on 25 bits : kind of "bigint", even if is still a 32bits-integer
             lbl_x = data->nb_lbl++;
             lbl_y = data->nb_lbl++;
             // Jump/Load the program after the bigint
-            _ortho(data, TMP1, 0, 0, -1);
-            _ortho(data, ACC, lbl_y, 1, -1);
-            _load_prog(data, TMP1, ACC, -1);
+            _ortho(data, regs[1], 0, 0, -1);
+            _ortho(data, regs[0], lbl_y, 1, -1);
+            _load_prog(data, regs[1], regs[0], -1);
             // Labelised bigint
             _bigint(data, expr->content.int_expr, lbl_x);
-            // After bigint : store the bigint in ACC
-            _ortho(data, ACC, lbl_x, 1, lbl_y);
-            _array_index(data, ACC, TMP1, ACC, -1);
+            // After bigint : store the bigint in the target register
+            _ortho(data, regs[0], lbl_x, 1, lbl_y);
+            _array_index(data, regs[0], regs[1], regs[0], -1);
         }
         break;
 
@@ -359,15 +509,15 @@ static void _compile_expr(AST_Expr expr, compiler_data_t *data) {
         break;
 
     case PAREN_EXPR:
-        _compile_expr(data, expr->content.paren_expr);
+        _compile_expr_in(expr->content.paren_expr, regs, nb_regs, data);
         break;
 
     case BINOP_EXPR:
-        _compile_binop(expr->content.binop_expr, data);
+        _compile_binop(expr->content.binop_expr, regs, nb_regs, 0, data);
         break;
 
     case UNOP_EXPR:
-        _compile_unop(expr->content.unop_expr, data);
+        _compile_unop(expr->content.unop_expr, regs, nb_regs, data);
         break;
 
     case APP_EXPR:
@@ -400,93 +550,115 @@ static void _compile_params(AST_Params params, compiler_data_t *data) {
     // TODO
 }
 
-// --- Compile a binary operation
-static void _compile_binop(AST_Binop binop, compiler_data_t *data) {
+// --- Compile a binary operation in regs[0], for a branch (as_test) the comparisons
+// can leave a value which is true (!=0) when they are false, 1 is returned then
+static int _compile_binop(AST_Binop binop, const int *regs, int nb_regs, int as_test, compiler_data_t *data) {
+
+    // The left operand (x) and the right one (y) end in two registers of regs, the
+    // operand needing the most registers is computed first so the other one can be
+    // computed with the remaining registers. The stack is only used when both
+    // operands need all the registers
+    int x, y;
+    int left_need = _register_need(binop->left);
+    int right_need = _register_need(binop->right);
+
+    if(left_need >= nb_regs && right_need >= nb_regs) {
+        _compile_expr_in(binop->left, regs, nb_regs, data);
+        _push(regs[0], data);
+        _compile_expr_in(binop->right, regs, nb_regs, data);
+        _pop(regs[1], data);
+        x = regs[1];
+        y = regs[0];
+    } else if(left_need >= right_need) {
+        _compile_expr_in(binop->left, regs, nb_regs, data);
+        _compile_expr_in(binop->right, regs + 1, nb_regs - 1, data);
+        x = regs[0];
+        y = regs[1];
+    } else {
+        _compile_expr_in(binop->right, regs, nb_regs, data);
+        _compile_expr_in(binop->left, regs + 1, nb_regs - 1, data);
+        x = regs[1];
+        y = regs[0];
+    }
 
-    // The left operand (x) will be in TMP1 and the right one (y) will be in ACC :
-    _compile_expr(binop->left, data);
-    _push(ACC, data);
-    _compile_expr(binop->right, data);
-    _pop(TMP1, data);
+    // The result (r) goes in regs[0] which holds one of the operands, the operations
+    // needing scratch registers (s, t) use regs[2] and regs[3]
+    int r = regs[0];
+    int s = nb_regs > 2 ? regs[2] : -1;
+    int t = nb_regs > 3 ? regs[3] : -1;
 
     switch (binop->binop_type) {
 
     case PLUS:
-        _add(data, ACC, ACC, TMP1, -1);
+        _add(data, r, x, y, -1);
         break;
 
     case MINUS:
         // x - y = x + (-1 * y)
-        _multiplication(data, ACC, ACC, MO, -1);
-        _add(data, ACC, TMP1, ACC, -1);
+        _multiplication(data, y, y, MO, -1);
+        _add(data, r, x, y, -1);
         break;
 
     case TIMES:
-        _multiplication(data, ACC, TMP1, ACC, -1);
+        _multiplication(data, r, x, y, -1);
         break;
 
     case DIVIDE:
-        _division(data, ACC, TMP1, ACC, -1);
+        _division(data, r, x, y, -1);
         break;
 
     case PERCENT:
         // x % y = res
-        _division(data, TMP2, TMP1, ACC, -1);       // x / y = n
-        _multiplication(data, TMP2, TMP2, ACC, -1); // n * y = x - res
-        _multiplication(data, TMP2, TMP2, MO, -1);  // x - (x - res) = res
-        _add(data, ACC, TMP1, TMP2, -1);
+        _division(data, s, x, y, -1);       // x / y = n
+        _multiplication(data, s, s, y, -1); // n * y = x - res
+        _multiplication(data, s, s, MO, -1);// x - (x - res) = res
+        _add(data, r, x, s, -1);
         break;
 
     case EQEQ:
-        // Algorithm based on the universal logical operator NAND, following Boole's algebra's rules :
-        _nand(data, TMP2, TMP1, ACC, -1);   // r = NAND(x, y)
-        _nand(data, TMP1, TMP2, TMP1, -1);  // r_x = NAND(r, x)
-        _nand(data, ACC, TMP2, ACC, -1);    // r_y = NAND(r, y)
-        _nand(data, TMP1, TMP1, ACC, -1);   // not_res = NAND(r_x, r_y)
-        // Interpretation of not_res :
-        // (not_res = 0) : x == y
-        // (not_res = 1) : x != y
-        // Initialisation of the result to true (1)
-        _ortho(data, ACC, 1, 0, -1);
-        // Put it at false (0) if not_res = 1
-        _cond_move(data, ACC, 0, TMP1, -1);
-        break;
-
-    case LTEQ:
-        // TODO
-        break;
-
-    case GTEQ:
-        // TODO
+        // The difference x - y is 0 only if x == y, a branch can use it as a negated
+        // condition, else the result is 1 put at 0 if the difference is not 0
+        _multiplication(data, y, y, MO, -1);
+        if(as_test) {
+            _add(data, r, x, y, -1);
+            return 1;
+        }
+        _add(data, r == x ? y : x, x, y, -1);
+        _ortho(data, r, 1, 0, -1);
+        _ortho(data, s, 0, 0, -1);
+        _cond_move(data, r, s, r == x ? y : x, -1);
         break;
 
     case LT:
-        // If x/y = 0, then x < y
-        _division(data, TMP1, TMP1, ACC, -1);
-        _ortho(data, ACC, 1, 0, -1);
-        _ortho(data, TMP2, 0, 0, -1);
-        _cond_move(data, ACC, TMP2, ACC, -1);
+        _less_than(data, r, x, y, s, t, 0, as_test);
         break;
 
     case GT:
-        // If y/x = 0, then x > y
-        _division(data, TMP1, ACC, TMP1, -1);
-        _ortho(data, ACC, 1, 0, -1);
-        _ortho(data, TMP2, 0, 0, -1);
-        _cond_move(data, ACC, TMP2, ACC, -1);
+        // x > y is y < x
+        _less_than(data, r, y, x, s, t, 0, as_test);
         break;
 
+    case LTEQ:
+        // x <= y is not (y < x), a branch can use y < x as a negated condition
+        _less_than(data, r, y, x, s, t, !as_test, as_test);
+        return as_test;
+
+    case GTEQ:
+        // x >= y is not (x < y), a branch can use x < y as a negated condition
+        _less_than(data, r, x, y, s, t, !as_test, as_test);
+        return as_test;
+
     case AND:
         // AND(x, y) = NAND(NAND(x, y), NAND(x,y)), following Boole's algebra's rules 
-        _nand(data, ACC, TMP1, ACC, -1);
-        _nand(data, ACC, ACC, ACC, -1);
+        _nand(data, r, x, y, -1);
+        _nand(data, r, r, r, -1);
         break;
 
     case OR:
         // AND(x, y) = NAND(NAND(x, x), NAND(y, y)), following Boole's algebra's rules 
-        _nand(data, TMP1, TMP1, TMP1, -1);
-        _nand(data, ACC, ACC, ACC, -1);
-        _nand(data, ACC, TMP1, ACC, -1);
+        _nand(data, x, x, x, -1);
+        _nand(data, y, y, y, -1);
+        _nand(data, r, x, y, -1);
         break;
     
     default:
@@ -494,22 +666,57 @@ static void _compile_binop(AST_Binop binop, compiler_data_t *data) {
 
     }
 
+    return 0;
 }
 
-// --- Compile an unary operation
-static void _compile_unop(AST_Unop unop, compiler_data_t *data) {
+// --- Compute the signed x < y (or not x < y with negate) as 0 or 1 in r, which is
+// x or y, with the scratches s and t, the operands are not kept. For a branch
+// (as_test) r is only non zero if x < y
+static void _less_than(compiler_data_t *data, int r, int x, int y, int s, int t, int negate, int as_test) {
+    // The sign bit of w = (x & ~y) | ((x | ~y) & (x - y)) is set only if x < y :
+    // if the signs of x and y differ it is the sign of x, else the one of the
+    // difference which can not overflow
+    _multiplication(data, s, y, MO, -1);    // s = -y
+    _add(data, s, x, s, -1);                // s = x - y
+    _nand(data, t, y, y, -1);               // t = ~y
+    _nand(data, t, x, t, -1);               // t = ~(x & ~y)
+    _nand(data, x, x, x, -1);               // x = ~x
+    _nand(data, x, x, y, -1);               // x = x | ~y
+    _nand(data, x, x, s, -1);               // x = ~((x | ~y) & (x - y))
+    _nand(data, x, t, x, -1);               // x = w
+    if(negate) {
+        _nand(data, x, x, x, -1);           // x = ~w
+    }
 
-    _compile_expr(unop->expr, data);
+    // 2^31 = 32768 * 32768 * 2, built without any division
+    _ortho(data, y, 32768, 0, -1);
+    _multiplication(data, y, y, y, -1);
+    _add(data, y, y, y, -1);
+
+    if(as_test) {
+        // A branch only needs the sign bit masked, r = w & 2^31
+        _nand(data, x, x, y, -1);
+        _nand(data, r, x, x, -1);
+    } else {
+        // The sign bit is extracted by an unsigned division by 2^31
+        _division(data, r, x, y, -1);
+    }
+}
+
+// --- Compile an unary operation in regs[0]
+static void _compile_unop(AST_Unop unop, const int *regs, int nb_regs, compiler_data_t *data) {
+
+    _compile_expr_in(unop->expr, regs, nb_regs, data);
 
     switch (unop->unop_type) {
 
     case NEGATE:
-        _multiplication(data, ACC, ACC, MO, -1);
+        _multiplication(data, regs[0], regs[0], MO, -1);
         break;
     
     case NOT:
         // NOT(x) = NAND(x, x), following Boole's algebra's rules 
-        _nand(data, ACC, ACC, ACC, -1);
+        _nand(data, regs[0], regs[0], regs[0], -1);
         break;
 
     default:
@@ -526,15 +733,35 @@ void compile(AST_Prog prog, compiler_data_t *data) {
     data->arr_offset = 0;
     data->lbl_instr_arr = (labeled_instruction **) malloc(data->arr_size * sizeof(labeled_instruction *));
     data->nb_lbl = 0;
+    data->pending_lbl = -1;
+    data->alias_size = 8;
+    data->lbl_alias_arr = (int *) malloc(data->alias_size * sizeof(int));
+    for(unsigned int i = 0 ; i < data->alias_size ; i++) {
+        data->lbl_alias_arr[i] = -1;
+    }
 
     // Registers initialisations
-    // ONE = 1, MO = -1 :
+    // ZERO = 0 (as all the registers at the start of the machine), ONE = 1, MO = -1 :
     _ortho(data, ONE, 1, 0, -1);
     _nand(data, MO, ONE, ONE, -1);
     _add(data, MO, MO, ONE, -1);
 
     // First pass : Compile the full AST
     _compile_prog(prog, data);
+    // The labels placed at the end go on a last instruction
+    if(data->pending_lbl != -1) {
+        _ortho(data, ZERO, 0, 0, -1);
+    }
+    _resolve_label_aliases(data);
+
+    // Optional pass : Simplify the labeled instructions
+    if(data->settings->opt_level >= 2) {
+        peephole_stats_t stats;
+        peephole_optimize(data, &stats);
+        if(data->settings->flags & VERBOSE_MASK) {
+            print_peephole_stats(&stats);
+        }
+    }
 
     // Second pass : Link the labels to their adress
     data->lbl_adress_arr = (int *) malloc(data->nb_lbl * sizeof(int));
@@ -543,9 +770,11 @@ void compile(AST_Prog prog, compiler_data_t *data) {
     // Third pass : Generate the bytecode with replacement of labels
     _generate_bytecode(data);
 
-    // Cleaning memory
+    // Cleaning memory, the AST and the instructions are released with the arena
     free(data->lbl_instr_arr);
-    clean_ast(prog);
+    free(data->lbl_adress_arr);
+    free(data->lbl_alias_arr);
+    arena_release(data->arena);
 
     // error_end:
     // return 1;
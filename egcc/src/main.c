@@ -5,8 +5,10 @@
 
 #include "main.h"
 #include "utils.h"
+#include "arena.h"
 #include "ast.h"
 #include "ast_printer.h"
+#include "ast_optimizer.h"
 #include "compiler.h"
 #include "parser.tab.h"
 
@@ -50,6 +52,11 @@ static int _parse_args(int argc, char *argv[], compiler_settings_t *settings) {
                 settings->flags |= VERBOSE_MASK;
             }
             
+            // Get the optimization level
+            if(strncmp("-O", current_arg, 2) == 0) {
+                settings->opt_level = current_arg[2] == '\0' ? 2 : (unsigned int) atoi(current_arg + 2);
+            }
+
             // Get the AST flag
             if(strcmp("--ast", current_arg) == 0) {
                 settings->flags |= AST_MASK;
@@ -75,9 +82,13 @@ static void _display_help() {
     printf("    -h : Display this help menu\n");
     printf("    -i <dir1:dir2> : Precise the include directories\n");
     printf("    -o <OUTPUT.egb> : Set the output file\n");
+    printf("    -O<level> : Set the optimization level (default 2)\n");
+    printf("        0 : No optimization\n");
+    printf("        1 : Constant folding on the AST\n");
+    printf("        2 : Constant folding and peephole optimization on the instructions\n");
     printf("    -v : Enable the verbose mode\n");
     printf("\n");
-    printf("    --ast : Display the ast before the compilation\n");
+    printf("    --ast : Display the ast before the compilation (after the constant folding)\n");
 }
 
 // --- The main function
@@ -86,6 +97,7 @@ int main(int argc, char *argv[]) {
     // Prepare the settings and the error structures
     compiler_settings_t settings;
     settings.flags = 0;
+    settings.opt_level = 2;
     settings.input_file_name = NULL;
     settings.input_file = NULL;
     settings.output_file_name = NULL;
@@ -119,17 +131,27 @@ int main(int argc, char *argv[]) {
     }
     settings.output_file = fopen(settings.output_file_name, "w");
 
+    // Create the arena of the compilation, the AST is allocated in it
+    arena_t arena;
+    arena_init(&arena);
+    set_ast_arena(&arena);
+
     // Open the input file and do the parsing
     settings.input_file = freopen(settings.input_file_name, "r", stdin);
-    AST_Prog *prog = (AST_Prog *) malloc(sizeof(AST_Prog));
-    if(yyparse(prog)) {
+    AST_Prog prog;
+    if(yyparse(&prog)) {
         return 1;
     }
 
+    // Simplify the AST before the compilation
+    if(settings.opt_level >= 1) {
+        optimize_ast(prog);
+    }
+
     // If the --ast flag is on, display the AST
     if(settings.flags & AST_MASK) {
         printf("=== AST : \n\n");
-        print_ast(*prog);
+        print_ast(prog);
         printf("\n");
     }
 
@@ -137,12 +159,10 @@ int main(int argc, char *argv[]) {
     compiler_data_t data;
     data.settings = &settings;
     data.error = &error;
+    data.arena = &arena;
 
-    // Do the compilation
-    compile(*prog, &data);
-
-    // Clean the memory
-    clean_ast(*prog);
+    // Do the compilation (the arena is released by the compiler)
+    compile(prog, &data);
 
     // Close the input and output files
     fclose(settings.output_file);
@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "peephole.h"
+#include "compiler.h"
+
+
+// ===== Internal function declarations =====
+
+static int _opcode(instruction *instr);
+static int _reads(instruction *instr, int reg);
+static int _writes(instruction *instr, int reg);
+static int _is_temporary(int reg);
+static int _is_value(known_value value, int val_type, int val);
+static void _forget(known_value *known, int *writers);
+static int _is_zero(known_value *known, int reg);
+static void _learn(known_value *known, int *writers, instruction *instr, unsigned int index);
+
+static unsigned int _next_live(compiler_data_t *data, unsigned int index);
+static void _remove(unsigned int index);
+static int _is_dead_from(compiler_data_t *data, unsigned int index, int reg);
+static int _final_target(compiler_data_t *data, int label);
+static int _falls_through(compiler_data_t *data, known_value *known, unsigned int index, int label);
+
+static unsigned int _thread_jumps(compiler_data_t *data, peephole_stats_t *stats);
+static unsigned int _remove_redundant(compiler_data_t *data, peephole_stats_t *stats);
+static unsigned int _forward_push_pop(compiler_data_t *data, peephole_stats_t *stats);
+static void _compact(compiler_data_t *data);
+
+
+// ===== Global variables =====
+
+static char *removed;
+static int *lbl_index;
+
+
+// ===== Functions to optimize the labeled instructions =====
+
+// The peephole optimizer works on lbl_instr_arr before the labels are linked, the
+// removed instructions are only marked during the passes and the array is
+// compacted at the end. A labeled instruction is never removed so the labels
+// always stay on a live instruction.
+
+// The register values are tracked through each basic block (from a labeled
+// instruction to the next one or to a jump) to find :
+// - the ORTHOs loading a value the register already holds
+// - the unconditional jumps (LOAD_PROG with B = 0 and C = a label) landing on
+//   the next instruction or after label carriers only, they are removed with the ORTHOs feeding them if their
+//   registers are dead after the jump
+// - the label loads targeting an unconditional jump, they are retargeted to its
+//   destination (jump threading)
+// The pushes followed by a pop with only register operations between them are
+// replaced by a register move, or removed if the pop restores the same register.
+
+// The passes are run until nothing changes.
+
+// --- Get the opcode of an instruction (-1 for a data word)
+static int _opcode(instruction *instr) {
+    switch (instr->op_type) {
+
+    case STD_OP:
+        return instr->content.std_op.opcode;
+
+    case ORTHO_OP:
+        return 13;
+
+    default:
+        return -1;
+
+    }
+}
+
+// --- Test if an instruction reads a register (a conditional move reads its target)
+static int _reads(instruction *instr, int reg) {
+    int a = instr->content.std_op.a;
+    int b = instr->content.std_op.b;
+    int c = instr->content.std_op.c;
+
+    switch (_opcode(instr)) {
+
+    case 0:
+    case 2:
+        return a == reg || b == reg || c == reg;
+
+    case 1:
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+    case 12:
+        return b == reg || c == reg;
+
+    case 8:
+    case 9:
+    case 10:
+        return c == reg;
+
+    default:
+        return 0;
+
+    }
+}
+
+// --- Test if an instruction writes a register
+static int _writes(instruction *instr, int reg) {
+    switch (_opcode(instr)) {
+
+    case 0:
+    case 1:
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+        return instr->content.std_op.a == reg;
+
+    case 8:
+        return instr->content.std_op.b == reg;
+
+    case 11:
+        return instr->content.std_op.c == reg;
+
+    case 13:
+        return instr->content.ortho_op.a == reg;
+
+    default:
+        return 0;
+
+    }
+}
+
+// --- Test if a register is a temporary of the compiler
+static int _is_temporary(int reg) {
+    return reg == TMP2 || reg == TMP3;
+}
+
+// --- Test if a known register value is the wanted one
+static int _is_value(known_value value, int val_type, int val) {
+    return (int) value.val_type == val_type && value.val == val;
+}
+
+// --- Forget all the register values at the start of a basic block
+static void _forget(known_value *known, int *writers) {
+    for(int i = 0 ; i < 8 ; i++) {
+        known[i].val_type = UNKNOWN_VAL;
+        known[i].val = 0;
+        writers[i] = -1;
+    }
+}
+
+// --- Test if a register holds 0 at a jump (ZERO always does, the compiler only
+// uses it in the expressions and clears it after them)
+static int _is_zero(known_value *known, int reg) {
+    return reg == ZERO || _is_value(known[reg], INT_VAL, 0);
+}
+
+// --- Update the register values after an instruction
+static void _learn(known_value *known, int *writers, instruction *instr, unsigned int index) {
+    if(instr->op_type == ORTHO_OP) {
+        int a = instr->content.ortho_op.a;
+        known[a].val_type = instr->content.ortho_op.val_is_target_lbl ? LABEL_VAL : INT_VAL;
+        known[a].val = instr->content.ortho_op.val;
+        writers[a] = (int) index;
+        return;
+    }
+
+    for(int reg = 0 ; reg < 8 ; reg++) {
+        if(_writes(instr, reg)) {
+            known[reg].val_type = UNKNOWN_VAL;
+            writers[reg] = -1;
+        }
+    }
+}
+
+// --- Get the first live instruction from an index
+static unsigned int _next_live(compiler_data_t *data, unsigned int index) {
+    while(index < data->arr_offset && removed[index]) {
+        index++;
+    }
+    return index;
+}
+
+// --- Mark an instruction as removed
+static void _remove(unsigned int index) {
+    removed[index] = 1;
+}
+
+// --- Test if a register is written before being read from an index (the end of
+// the program and a halt count as a write, a jump or a data word as a read)
+static int _is_dead_from(compiler_data_t *data, unsigned int index, int reg) {
+    unsigned int i = _next_live(data, index);
+    for(int count = 0 ; i < data->arr_offset && count < PEEPHOLE_LIVE_WINDOW ; count++) {
+        instruction *instr = data->lbl_instr_arr[i]->instr;
+        int opcode = _opcode(instr);
+        if(opcode == -1 || opcode == 12 || _reads(instr, reg)) {
+            return 0;
+        }
+        if(opcode == 7 || _writes(instr, reg)) {
+            return 1;
+        }
+        i = _next_live(data, i + 1);
+    }
+    return i >= data->arr_offset;
+}
+
+// --- Follow the unconditional jumps from a label (only preceded by temporary loads
+// which are dead at the destination) and return the final label
+static int _final_target(compiler_data_t *data, int label) {
+    known_value known[8];
+    int writers[8];
+    unsigned int skipped = 0;
+
+    for(int hop = 0 ; hop < PEEPHOLE_MAX_HOPS ; hop++) {
+
+        // Skip the temporary loads at the label
+        _forget(known, writers);
+        unsigned int i = _next_live(data, (unsigned int) lbl_index[label]);
+        while(i < data->arr_offset && data->lbl_instr_arr[i]->instr->op_type == ORTHO_OP && _is_temporary(data->lbl_instr_arr[i]->instr->content.ortho_op.a)) {
+            _learn(known, writers, data->lbl_instr_arr[i]->instr, i);
+            skipped |= 1 << data->lbl_instr_arr[i]->instr->content.ortho_op.a;
+            i = _next_live(data, i + 1);
+        }
+
+        // Stop if it is not an unconditional jump
+        if(i >= data->arr_offset || _opcode(data->lbl_instr_arr[i]->instr) != 12) {
+            return label;
+        }
+        int b = data->lbl_instr_arr[i]->instr->content.std_op.b;
+        int c = data->lbl_instr_arr[i]->instr->content.std_op.c;
+        if(!_is_zero(known, b) || known[c].val_type != LABEL_VAL || known[c].val == label) {
+            return label;
+        }
+
+        // The skipped loads must not be needed at the destination
+        unsigned int destination = (unsigned int) lbl_index[known[c].val];
+        for(int reg = 0 ; reg < 8 ; reg++) {
+            if((skipped & (1 << reg)) && !_is_dead_from(data, destination, reg)) {
+                return label;
+            }
+        }
+        label = known[c].val;
+
+    }
+
+    return label;
+}
+
+// --- Test if the instructions between a jump and its label do nothing (only
+// ORTHOs loading the values the registers already hold, like the label carriers)
+static int _falls_through(compiler_data_t *data, known_value *known, unsigned int index, int label) {
+    unsigned int target = _next_live(data, (unsigned int) lbl_index[label]);
+    if(target <= index) {
+        return 0;
+    }
+
+    for(unsigned int i = _next_live(data, index + 1) ; i < target ; i = _next_live(data, i + 1)) {
+        instruction *instr = data->lbl_instr_arr[i]->instr;
+        if(instr->op_type != ORTHO_OP || !_is_value(known[instr->content.ortho_op.a], instr->content.ortho_op.val_is_target_lbl ? LABEL_VAL : INT_VAL, instr->content.ortho_op.val)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// --- Retarget the label loads to the end of their jump chains
+static unsigned int _thread_jumps(compiler_data_t *data, peephole_stats_t *stats) {
+    unsigned int changes = 0;
+
+    for(unsigned int i = _next_live(data, 0) ; i < data->arr_offset ; i = _next_live(data, i + 1)) {
+        instruction *instr = data->lbl_instr_arr[i]->instr;
+        if(instr->op_type != ORTHO_OP || !instr->content.ortho_op.val_is_target_lbl) {
+            continue;
+        }
+        int target = _final_target(data, instr->content.ortho_op.val);
+        if(target != instr->content.ortho_op.val) {
+            instr->content.ortho_op.val = target;
+            stats->jump_thread++;
+            changes++;
+        }
+    }
+
+    return changes;
+}
+
+// --- Remove the redundant ORTHOs and the jumps to the next instruction
+static unsigned int _remove_redundant(compiler_data_t *data, peephole_stats_t *stats) {
+    unsigned int changes = 0;
+    known_value known[8];
+    int writers[8];
+    _forget(known, writers);
+
+    for(unsigned int i = _next_live(data, 0) ; i < data->arr_offset ; i = _next_live(data, i + 1)) {
+        labeled_instruction *lbl_instr = data->lbl_instr_arr[i];
+        instruction *instr = lbl_instr->instr;
+        int opcode = _opcode(instr);
+
+        // A label starts a new basic block
+        if(lbl_instr->label != -1) {
+            _forget(known, writers);
+        }
+
+        switch (opcode) {
+
+        case 13: // Ortho, removed if the register already holds the value
+            if(lbl_instr->label == -1 && _is_value(known[instr->content.ortho_op.a], instr->content.ortho_op.val_is_target_lbl ? LABEL_VAL : INT_VAL, instr->content.ortho_op.val)) {
+                _remove(i);
+                stats->ortho++;
+                changes++;
+            } else {
+                _learn(known, writers, instr, i);
+            }
+            break;
+
+        case 12: // Load prog, removed if it is an unconditional jump falling through its label
+            if(_is_zero(known, instr->content.std_op.b) && known[instr->content.std_op.c].val_type == LABEL_VAL
+                && _falls_through(data, known, i, known[instr->content.std_op.c].val)) {
+                _remove(i);
+                stats->jump_next++;
+                changes++;
+
+                // Remove the loads of the jump registers if nothing else reads them
+                int regs[2] = {instr->content.std_op.b, instr->content.std_op.c};
+                for(int r = 0 ; r < 2 ; r++) {
+                    int writer = writers[regs[r]];
+                    if(writer != -1 && data->lbl_instr_arr[writer]->label == -1 && _is_temporary(regs[r]) && _is_dead_from(data, (unsigned int) writer + 1, regs[r])) {
+                        _remove((unsigned int) writer);
+                        stats->jump_next++;
+                        changes++;
+                    }
+                }
+            }
+            _forget(known, writers);
+            break;
+
+        case 7:
+        case -1:
+            _forget(known, writers);
+            break;
+
+        default:
+            _learn(known, writers, instr, i);
+            break;
+
+        }
+    }
+
+    return changes;
+}
+
+// --- Replace a push and the next pop by a register move if only register
+// operations are between them
+static unsigned int _forward_push_pop(compiler_data_t *data, peephole_stats_t *stats) {
+    unsigned int changes = 0;
+    labeled_instruction **arr = data->lbl_instr_arr;
+
+    for(unsigned int i = _next_live(data, 0) ; i < data->arr_offset ; i = _next_live(data, i + 1)) {
+
+        // Match the push : ARRAY_UPDATE SA SP X, ADD SP SP ONE
+        instruction *push = arr[i]->instr;
+        if(_opcode(push) != 2 || push->content.std_op.a != SA || push->content.std_op.b != SP) {
+            continue;
+        }
+        int x = push->content.std_op.c;
+        unsigned int push_end = _next_live(data, i + 1);
+        if(push_end >= data->arr_offset || arr[push_end]->label != -1 || _opcode(arr[push_end]->instr) != 3
+            || arr[push_end]->instr->content.std_op.a != SP || arr[push_end]->instr->content.std_op.b != SP || arr[push_end]->instr->content.std_op.c != ONE) {
+            continue;
+        }
+
+        // Find the pop after the register operations : ADD SP SP MO, ARRAY_INDEX Y SA SP
+        unsigned int middle_start = _next_live(data, push_end + 1);
+        unsigned int pop = middle_start;
+        int found = 0;
+        for(int count = 0 ; pop < data->arr_offset && count <= PEEPHOLE_PUSH_WINDOW ; count++) {
+            instruction *instr = arr[pop]->instr;
+            int opcode = _opcode(instr);
+            if(arr[pop]->label != -1) {
+                break;
+            }
+            if(opcode == 3 && instr->content.std_op.a == SP && instr->content.std_op.b == SP && instr->content.std_op.c == MO) {
+                found = 1;
+                break;
+            }
+            if((opcode != 0 && (opcode < 3 || opcode > 6) && opcode != 13) || _reads(instr, SP) || _writes(instr, SP) || _reads(instr, SA) || _writes(instr, SA)) {
+                break;
+            }
+            pop = _next_live(data, pop + 1);
+        }
+        if(!found) {
+            continue;
+        }
+        unsigned int pop_end = _next_live(data, pop + 1);
+        if(pop_end >= data->arr_offset || arr[pop_end]->label != -1 || _opcode(arr[pop_end]->instr) != 1
+            || arr[pop_end]->instr->content.std_op.b != SA || arr[pop_end]->instr->content.std_op.c != SP) {
+            continue;
+        }
+        int y = arr[pop_end]->instr->content.std_op.a;
+        if(y == SP || y == SA || x == SP || x == SA) {
+            continue;
+        }
+
+        // The register operations must not use the popped register
+        int uses_y = 0;
+        for(unsigned int m = middle_start ; m < pop ; m = _next_live(data, m + 1)) {
+            uses_y |= _reads(arr[m]->instr, y) || _writes(arr[m]->instr, y);
+        }
+        if(uses_y) {
+            continue;
+        }
+
+        // Move the value at the push (a move to itself is removed if it holds no label)
+        if(x == y && arr[i]->label == -1) {
+            _remove(i);
+            stats->push_pop++;
+        } else {
+            push->content.std_op.opcode = 0;
+            push->content.std_op.a = y;
+            push->content.std_op.b = x;
+            push->content.std_op.c = ONE;
+        }
+        _remove(push_end);
+        _remove(pop);
+        _remove(pop_end);
+        stats->push_pop += 3;
+        changes++;
+    }
+
+    return changes;
+}
+
+// --- Compact the array without the removed instructions (they stay in the arena)
+static void _compact(compiler_data_t *data) {
+    unsigned int size = 0;
+    for(unsigned int i = 0 ; i < data->arr_offset ; i++) {
+        if(!removed[i]) {
+            data->lbl_instr_arr[size++] = data->lbl_instr_arr[i];
+        }
+    }
+    data->arr_offset = size;
+}
+
+// --- Run the peephole passes over the labeled instructions
+void peephole_optimize(compiler_data_t *data, peephole_stats_t *stats) {
+
+    memset(stats, 0, sizeof(peephole_stats_t));
+    stats->initial_size = data->arr_offset;
+
+    // Prepare the removal marks and the label positions
+    removed = (char *) calloc(data->arr_offset + 1, sizeof(char));
+    lbl_index = (int *) malloc((data->nb_lbl + 1) * sizeof(int));
+    for(unsigned int i = 0 ; i < data->arr_offset ; i++) {
+        if(data->lbl_instr_arr[i]->label != -1) {
+            lbl_index[data->lbl_instr_arr[i]->label] = (int) i;
+        }
+    }
+
+    // Run the passes until nothing changes
+    unsigned int changes = 1;
+    while(changes > 0 && stats->passes < PEEPHOLE_MAX_PASSES) {
+        stats->passes++;
+        changes = _thread_jumps(data, stats);
+        changes += _remove_redundant(data, stats);
+        changes += _forward_push_pop(data, stats);
+    }
+
+    _compact(data);
+    stats->final_size = data->arr_offset;
+
+    free(removed);
+    free(lbl_index);
+
+}
+
+// --- Print the statistics of the peephole optimizer
+void print_peephole_stats(peephole_stats_t *stats) {
+    printf("=== Peephole : \n\n");
+    printf("    instructions : %u -> %u (%u removed in %u passes)\n", stats->initial_size, stats->final_size, stats->initial_size - stats->final_size, stats->passes);
+    printf("    push/pop : %u removed\n", stats->push_pop);
+    printf("    redundant orthos : %u removed\n", stats->ortho);
+    printf("    jumps to the next instruction : %u removed\n", stats->jump_next);
+    printf("    threaded jumps : %u\n", stats->jump_thread);
+    printf("\n");
+}
@@ -4,6 +4,13 @@
 
 #include "utils.h"
 
+// SIMD imports for the buffer endianess reversing
+#if defined(__AVX2__) || defined(__SSSE3__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
 
 // ===== Utils functions =====
 
@@ -74,4 +81,42 @@ char *change_extension(char *file_name, char *new_extension) {
 // --- Reverse an int endianess
 int reverse(int to_reverse) {
     return ((to_reverse>>24)&0xFF) | ((to_reverse<<8)&0xFF0000) | ((to_reverse>>8)&0xFF00) | ((to_reverse<<24)&0xFF000000);
+}
+
+// --- Reverse the endianess of a whole buffer (the destination can be the source)
+void reverse_buffer(unsigned int *dst, const unsigned int *src, unsigned int size) {
+
+    unsigned int i = 0;
+
+#if defined(__AVX2__)
+    // AVX2 : Shuffle the bytes of 8 ints at a time
+    const __m256i mask = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                         12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for(; i + 8 <= size ; i += 8) {
+        __m256i words = _mm256_loadu_si256((const __m256i *) (src + i));
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_shuffle_epi8(words, mask));
+    }
+#elif defined(__SSSE3__)
+    // SSSE3 : Shuffle the bytes of 4 ints at a time
+    const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for(; i + 4 <= size ; i += 4) {
+        __m128i words = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_shuffle_epi8(words, mask));
+    }
+#elif defined(__SSE2__)
+    // SSE2 : Swap the bytes of each half then swap the halves of 4 ints at a time
+    for(; i + 4 <= size ; i += 4) {
+        __m128i words = _mm_loadu_si128((const __m128i *) (src + i));
+        words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+        words = _mm_shufflelo_epi16(words, 0xB1);
+        words = _mm_shufflehi_epi16(words, 0xB1);
+        _mm_storeu_si128((__m128i *) (dst + i), words);
+    }
+#endif
+
+    // Portable fallback for the remaining ints
+    for(; i < size ; i++) {
+        dst[i] = (unsigned int) reverse((int) src[i]);
+    }
+
 }
\ No newline at end of file
@@ -0,0 +1,15 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include "machine.h"
+
+
+// ===== Exported functions =====
+
+void init_allocator(machine_data_t *data);
+void clean_allocator(machine_data_t *data);
+table_t *new_table(machine_data_t *data, unsigned int size);
+void delete_table(machine_data_t *data, table_t *table);
+
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef CHECKED_EXECUTER_H
+#define CHECKED_EXECUTER_H
+
+#include "machine.h"
+
+
+// ===== Functions =====
+
+void checked_execute(machine_data_t *data);
+
+
+#endif
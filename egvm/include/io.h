@@ -0,0 +1,27 @@
+#ifndef IO_H
+#define IO_H
+
+#include "machine.h"
+
+// --- Inline to append a char to the output buffer and flush it if needed
+#define OUTPUT_CHAR(data, c) \
+    (data)->output_buffer[(data)->output_size++] = (char) (c); \
+    if((data)->output_size >= OUTPUT_BUFFER_SIZE || ((char) (c) == '\n' && ((data)->flags & LINE_OUTPUT_FLAG))) { \
+        flush_output(data); \
+    }
+
+// --- Inline to read a char from the input buffer and fill it if needed
+#define INPUT_CHAR(data) \
+    ((data)->input_pos < (data)->input_size ? (data)->input_buffer[(data)->input_pos++] : fill_input(data))
+
+
+// ===== Exported functions =====
+
+void init_output(machine_data_t *data, int fd);
+void flush_output(machine_data_t *data);
+void init_input(machine_data_t *data, int fd);
+void clean_input(machine_data_t *data);
+char fill_input(machine_data_t *data);
+
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "machine.h"
+
+// Define the JIT parameters
+#define JIT_CACHE_SIZE (32 * 1024 * 1024)
+#define JIT_BLOCK_MAX 512
+#define JIT_INSTR_MAX_SIZE 256
+
+// Define the reasons to leave the native code
+#define JIT_EXIT_HALT 0
+#define JIT_EXIT_JUMP 1
+#define JIT_EXIT_RUNTIME 2
+
+
+// ===== Structure definitions =====
+
+// This structure contains the state of the JIT compiler
+typedef struct {
+    unsigned char *cache;
+    unsigned char *cache_p;
+    unsigned char *cache_end;
+    unsigned char *enter;
+    unsigned char *exit;
+    unsigned char *blocks_start;
+
+    void **blocks;
+    unsigned char *covered;
+    unsigned int size;
+    int reason;
+} jit_state_t;
+
+
+// ===== Functions =====
+
+void jit_execute(machine_data_t *data);
+
+
+#endif
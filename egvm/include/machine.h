@@ -1,6 +1,8 @@
 #ifndef MACHINE_H
 #define MACHINE_H
 
+#include <stdint.h>
+
 // Define macros to factorize the OS detection
 #if defined(__unix) || defined(unix) || defined (__unix__)
     #define EG_UNIX
@@ -19,6 +21,11 @@
 #define COMMAND_ERROR 3
 #define OUTPUT_ERROR 4
 #define DIVIDE_BY_ZERO 5
+#define SNAPSHOT_ERROR 6
+#define STEP_LIMIT_ERROR 7
+#define TABLE_LIMIT_ERROR 8
+#define MEMORY_LIMIT_ERROR 9
+#define FILE_ERROR 10
 
 // Define flags mask
 #define RUNNING_FLAG 0b1
@@ -26,6 +33,59 @@
 #define LOG_FLAG 0b100
 #define DEBUG_FLAG 0b1000
 #define HELP_FLAG 0b10000
+#define SLAB_FLAG 0b100000
+#define VERBOSE_FLAG 0b1000000
+#define LINE_OUTPUT_FLAG 0b10000000
+#define STATS_FLAG 0b100000000
+#define PROFILE_FLAG 0b1000000000
+#define JIT_FLAG 0b10000000000
+#define RECORDER_FLAG 0b100000000000
+#define CHECKED_FLAG 0b1000000000000
+
+// Define the input and output buffer sizes
+#define INPUT_BUFFER_SIZE 65536
+#define OUTPUT_BUFFER_SIZE 8192
+
+// Define the shared index of a program sharing an image which is not in the table array
+#define SHARED_IMAGE 0xFFFFFFFF
+
+// Define the tag of a freed slot of the table array (a freed slot holds the tagged
+// address of the next free slot, which cannot be mistaken for a table)
+#define FREED_TAG ((uintptr_t) 1)
+
+// --- Inline to make the content of a freed slot from the next free slot
+#define FREE_LINK(next) \
+    ((table_t *) ((uintptr_t) (next) | FREED_TAG))
+
+// --- Inline to get the next free slot from a freed slot
+#define FREE_NEXT(slot) \
+    ((table_t **) ((uintptr_t) *(slot) & ~FREED_TAG))
+
+// --- Inline to test if a slot of the table array holds no table (freed or empty)
+#define NO_TABLE(table) \
+    ((table) == NULL || ((uintptr_t) (table) & FREED_TAG))
+
+// Define the value of a disabled resource limit
+#define NO_LIMIT 0xFFFFFFFFFFFFFFFFULL
+
+// --- Inline to test if the instruction limit is reached (checked at the jumps)
+#define STEPS_EXCEEDED(data) \
+    __builtin_expect((data)->stats.steps >= (data)->max_steps, 0)
+
+// Define the superinstructions fused by the executer
+#define FUSION_NUMBER 7
+#define FUSION_PUSH 0
+#define FUSION_POP 1
+#define FUSION_EQUAL 2
+#define FUSION_BRANCH 3
+#define FUSION_JUMP 4
+#define FUSION_BRANCH_ZERO 5
+#define FUSION_JUMP_ZERO 6
+
+// Define the slab allocator parameters (classes of 1 to 512 ints)
+#define SLAB_CLASS_NUMBER 10
+#define SLAB_CHUNK_SIZE 65536
+#define SLAB_CHUNK_HEADER 16
 
 
 // ===== Structure definitions =====
@@ -43,13 +103,53 @@ typedef struct {
     int content[];
 } table_t;
 
+// This structure represents the slab allocator for the small tables
+typedef struct {
+    void *chunks;
+    char *chunk_p;
+    char *chunk_end;
+    table_t *free_lists[SLAB_CLASS_NUMBER];
+} table_pool_t;
+
+// This structure contains the execution statistics of the machine
+typedef struct {
+    unsigned long long steps;
+    unsigned long long allocations;
+    unsigned long long frees;
+    unsigned int live_tables;
+    unsigned int peak_tables;
+    unsigned long long live_memory;
+    double load_time;
+    double exec_time;
+    unsigned long long fusions[FUSION_NUMBER];
+} machine_stats_t;
+
+// This structure represents a command recorded by the flight recorder with
+// the value of the register it writes before its execution (the other
+// registers are rebuilt from the current ones when the recorder is dumped)
+typedef struct {
+    unsigned int exec_p;
+    unsigned int command;
+    int previous;
+} recorder_entry_t;
+
+// This structure contains the ring buffer of the last executed commands
+typedef struct {
+    recorder_entry_t *entries;
+    unsigned int size;
+    unsigned int pos;
+    char full;
+    char *dump_file;
+    volatile int signal;
+} recorder_t;
+
 // This structure contains all information for the machine to run
 typedef struct {
     machine_error_t *error;
     char *egb_file_name;
     char *log_file;
 
-    unsigned char flags;
+    unsigned int flags;
 
     unsigned int exec_p;
     int registers[REGISTER_NUMBER];
@@ -58,6 +158,35 @@ typedef struct {
     unsigned int table_array_size;
     table_t **free_start;
     table_t **table_array;
+
+    unsigned int shared_index;
+
+    table_pool_t pool;
+
+    int output_fd;
+    unsigned int output_size;
+    char output_buffer[OUTPUT_BUFFER_SIZE];
+
+    int input_fd;
+    unsigned int input_size;
+    unsigned int input_pos;
+    char input_buffer[INPUT_BUFFER_SIZE];
+
+    machine_stats_t stats;
+
+    unsigned long long max_steps;
+    unsigned long long max_tables;
+    unsigned long long max_memory;
+
+    recorder_t recorder;
+
+    char *snapshot_file;
+    char *restore_file;
+    volatile unsigned long long snapshot_at;
+
+    const table_t *program_image;
+    char *server_socket;
+    unsigned int server_workers;
 } machine_data_t;
 
 // ===== Exported functions =====
@@ -66,6 +195,8 @@ void raise_machine_error(machine_data_t *data, int error_code, char *error_messa
 void run_machine(machine_data_t *data);
 unsigned int allocate_table(machine_data_t *data, unsigned int size);
 void free_table(machine_data_t *data, unsigned int index);
+void load_program(machine_data_t *data, unsigned int index);
+void unshare_program(machine_data_t *data);
 
 
 #endif
\ No newline at end of file
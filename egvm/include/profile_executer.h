@@ -0,0 +1,15 @@
+#ifndef PROFILE_EXECUTER_H
+#define PROFILE_EXECUTER_H
+
+#include "machine.h"
+
+// Define the number of hot addresses in the report
+#define PROFILE_HOT_NUMBER 20
+
+
+// ===== Functions =====
+
+void profile_execute(machine_data_t *data);
+
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <sys/types.h>
+
+#include "machine.h"
+
+// Define the number of file paths remembered by the cache
+#define PROGRAM_CACHE_SIZE 64
+
+
+// ===== Structure definitions =====
+
+// This structure represents a loaded program shared by the machine instances
+typedef struct program_s {
+    unsigned long long hash;
+    table_t *image;
+    unsigned int refs;
+    struct program_s *next;
+} program_t;
+
+// This structure represents a file path known by the cache
+typedef struct {
+    char *path;
+    time_t mtime;
+    off_t size;
+    program_t *program;
+    unsigned long long last_use;
+} program_path_t;
+
+
+// ===== Functions =====
+
+const table_t *acquire_program(const char *path);
+void release_program(const table_t *image);
+void clean_program_cache();
+
+
+#endif
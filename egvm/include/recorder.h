@@ -0,0 +1,37 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "machine.h"
+#include "utils.h"
+
+// Define the default number of recorded commands
+#define RECORDER_DEFAULT_SIZE 4096
+
+// --- Macro to get the register written by a command (the A register for the
+// commands which write nothing, so restoring it changes nothing)
+#define WRITTEN_REGISTER(command) \
+    (((unsigned int) (command) >> COMMAND_SHIFT) == 8 ? ((unsigned int) (command) >> B_SHIFT) & ARG_MASK : \
+    ((unsigned int) (command) >> COMMAND_SHIFT) == 11 ? ((unsigned int) (command) >> C_SHIFT) & ARG_MASK : \
+    ((unsigned int) (command) >> COMMAND_SHIFT) == 13 ? ((unsigned int) (command) >> A_SPEC_SHIFT) & ARG_MASK : \
+    ((unsigned int) (command) >> A_SHIFT) & ARG_MASK)
+
+// --- Inline to record a command and the value of its written register before its execution
+#define RECORD_STEP(data, address, word, value) \
+    (data)->recorder.entries[(data)->recorder.pos].exec_p = (address); \
+    (data)->recorder.entries[(data)->recorder.pos].command = (word); \
+    (data)->recorder.entries[(data)->recorder.pos].previous = (value); \
+    if(++(data)->recorder.pos == (data)->recorder.size) { \
+        (data)->recorder.pos = 0; \
+        (data)->recorder.full = 1; \
+    }
+
+
+// ===== Functions =====
+
+void init_recorder(machine_data_t *data);
+void clean_recorder(machine_data_t *data);
+void dump_recorder(machine_data_t *data);
+void check_recorder_signal(machine_data_t *data);
+
+
+#endif
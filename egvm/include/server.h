@@ -0,0 +1,38 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+
+#include "machine.h"
+
+// Define the server parameters
+#define SERVER_WORKERS_MAX 32
+#define SERVER_QUEUE_SIZE 256
+#define SERVER_PATH_MAX 4096
+
+
+// ===== Structure definitions =====
+
+// This structure contains the state of the server shared by the workers
+typedef struct {
+    int listen_fd;
+    unsigned int flags;
+    unsigned long long max_steps;
+    unsigned long long max_tables;
+    unsigned long long max_memory;
+
+    int queue[SERVER_QUEUE_SIZE];
+    unsigned int queue_start;
+    unsigned int queue_size;
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_filled;
+    pthread_cond_t queue_emptied;
+} server_t;
+
+
+// ===== Functions =====
+
+int run_server(machine_data_t *settings);
+
+
+#endif
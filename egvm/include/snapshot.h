@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "machine.h"
+
+// Define the snapshot file header
+#define SNAPSHOT_MAGIC 0x4E534745
+#define SNAPSHOT_VERSION 1
+
+// Define the table markers of a snapshot
+#define SNAPSHOT_FREE_TABLE 0xFFFFFFFF
+#define SNAPSHOT_SHARED_TABLE 0xFFFFFFFE
+
+// Define the instruction count of a disabled snapshot
+#define SNAPSHOT_NEVER 0xFFFFFFFFFFFFFFFFULL
+
+// --- Inline to test if a snapshot is requested (instruction count reached or signal)
+#define SNAPSHOT_DUE(data) \
+    __builtin_expect((data)->stats.steps >= (data)->snapshot_at, 0)
+
+
+// ===== Functions =====
+
+void init_snapshot(machine_data_t *data);
+void clean_snapshot(machine_data_t *data);
+void take_snapshot(machine_data_t *data);
+int restore_snapshot(machine_data_t *data, const char *file_name);
+
+
+#endif
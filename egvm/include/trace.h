@@ -0,0 +1,37 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+#include "machine.h"
+
+// Define the trace file header
+#define TRACE_MAGIC 0x52544745
+#define TRACE_VERSION 1
+
+// Define the trace buffer size and the maximal size of a record
+// (execution pointer, command, changed register mask and values)
+#define TRACE_BUFFER_SIZE (1024 * 1024)
+#define TRACE_RECORD_MAX_SIZE (4 + 4 + 1 + 4 * REGISTER_NUMBER)
+
+
+// ===== Structure definitions =====
+
+// This structure contains the state of a binary trace writer
+typedef struct {
+    FILE *file;
+    unsigned char *buffer;
+    unsigned int size;
+    int registers[REGISTER_NUMBER];
+} trace_t;
+
+
+// ===== Functions =====
+
+int open_trace(trace_t *trace, const char *file_name);
+void write_trace(trace_t *trace, unsigned int exec_p, unsigned int command, const int *registers);
+void close_trace(trace_t *trace);
+int decode_trace(FILE *input, FILE *output);
+
+
+#endif
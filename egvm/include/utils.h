@@ -8,7 +8,6 @@
     #include <byteswap.h>
 
     #define REVERSER __bswap_32
-    #define CHAR_READER unix_read_char
 #elif EG_WINDOWS
     // Do Windows define
 #elif EG_MAC
@@ -25,18 +24,22 @@
 #define C_SHIFT 0
 #define A_SPEC_SHIFT 25
 
+// Tag word at the start of an egb file already in the native endianess
+#define EGB_NATIVE_MAGIC 0x4E4745FF
+
 
 // ===== Exported functions =====
 
-table_t *read_egb_file(const char *file_name);
-void write_step(machine_data_t *data, unsigned int command, FILE *file);
+table_t *read_egb_file(machine_data_t *data, const char *file_name);
+void write_step(const int *registers, unsigned int command, FILE *file);
 char *change_extension(char *file_name, char *new_extension);
+double get_time();
 
 int reverse(int to_reverse);
+void reverse_buffer(unsigned int *dst, const unsigned int *src, unsigned int size);
 int identity(int ident);
 
-char unix_read_char();
-
+const char *get_command_name(int command);
 int get_command(unsigned int command);
 int get_arg_a(unsigned int command);
 int get_arg_b(unsigned int command);
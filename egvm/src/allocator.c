@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "machine.h"
+
+
+// ===== Functions to allocate the tables memory =====
+
+// Small tables are allocated in slab chunks, each table is placed in the size
+// class of the next power of two of its size and freed tables are kept in a
+// free list per size class. Chunks are allocated zeroed so only the recycled
+// tables need to be cleared. Big tables are directly allocated with malloc, as
+// the tables allocated without a machine (NULL data) which outlive the machines.
+
+// --- Internal function declarations
+static unsigned int _size_class(unsigned int size);
+static table_t *_slab_allocate(table_pool_t *pool, unsigned int class);
+
+// --- Get the size class of a table size
+static unsigned int _size_class(unsigned int size) {
+    return size <= 1 ? 0 : 32 - __builtin_clz(size - 1);
+}
+
+// --- Allocate a zeroed block of the wanted class in the current chunk
+static table_t *_slab_allocate(table_pool_t *pool, unsigned int class) {
+
+    // Get the block size aligned on a pointer size
+    unsigned int block_size = ((1u << class) + 1) * sizeof(int);
+    block_size = (block_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    // Allocate a new chunk if the current one is full
+    if(pool->chunk_p + block_size > pool->chunk_end) {
+        void **chunk = (void **) calloc(1, SLAB_CHUNK_SIZE);
+        *chunk = pool->chunks;
+        pool->chunks = chunk;
+        pool->chunk_p = (char *) chunk + SLAB_CHUNK_HEADER;
+        pool->chunk_end = (char *) chunk + SLAB_CHUNK_SIZE;
+    }
+
+    // Take the block in the chunk
+    table_t *res = (table_t *) pool->chunk_p;
+    pool->chunk_p += block_size;
+
+    return res;
+
+}
+
+// --- Initialize the table allocator
+void init_allocator(machine_data_t *data) {
+
+    data->pool.chunks = NULL;
+    data->pool.chunk_p = NULL;
+    data->pool.chunk_end = NULL;
+    for(int i = 0 ; i < SLAB_CLASS_NUMBER ; i++) {
+        data->pool.free_lists[i] = NULL;
+    }
+
+}
+
+// --- Free all the slab chunks
+void clean_allocator(machine_data_t *data) {
+
+    void **chunk = (void **) data->pool.chunks;
+    while(chunk != NULL) {
+        void **next = (void **) *chunk;
+        free(chunk);
+        chunk = next;
+    }
+    init_allocator(data);
+
+}
+
+// --- Allocate a new zeroed table with the wanted size
+table_t *new_table(machine_data_t *data, unsigned int size) {
+
+    table_t *res;
+    unsigned int class = _size_class(size);
+
+    // Use malloc for the big tables, without a machine or if the slab allocator is disabled
+    if(data == NULL || !(data->flags & SLAB_FLAG) || class >= SLAB_CLASS_NUMBER) {
+        res = (table_t *) calloc(size + 1, sizeof(int));
+    } else
+
+    // Recycle a freed table of the same class
+    if(data->pool.free_lists[class] != NULL) {
+        res = data->pool.free_lists[class];
+        data->pool.free_lists[class] = *((table_t **) res);
+        memset((void *) res, 0, (size + 1) * sizeof(int));
+    }
+
+    // Else take a new block in the slab chunk
+    else {
+        res = _slab_allocate(&data->pool, class);
+    }
+
+    res->size = size;
+    return res;
+
+}
+
+// --- Free a table allocated with new_table
+void delete_table(machine_data_t *data, table_t *table) {
+
+    unsigned int class = _size_class(table->size);
+
+    if(data == NULL || !(data->flags & SLAB_FLAG) || class >= SLAB_CLASS_NUMBER) {
+        free(table);
+    } else {
+        *((table_t **) table) = data->pool.free_lists[class];
+        data->pool.free_lists[class] = table;
+    }
+
+}
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checked_executer.h"
+#include "machine.h"
+#include "utils.h"
+#include "io.h"
+#include "snapshot.h"
+#include "recorder.h"
+
+// ===== Functions and macros to execute the code safely with threaded dispatch =====
+
+// This executer does the same validations as the debug executer (table and
+// plate bounds, division by zero, freed tables, output range, execution pointer)
+// with the pre-decoded threaded dispatch of the unsafe executer
+
+// The checks are inline and predicted as passing, a failing check jumps to an
+// error label at the end of the function which writes the state back and raises
+// the machine error, so the fast path only pays a compare and a branch
+
+// With the flight recorder the commands are decoded to a recording twin of
+// their handler which writes the ring entry then goes to the handler, so the
+// recorder costs nothing when it is disabled and keeps the threaded dispatch
+// when it is enabled
+
+// --- Macro to get the registers
+#define R_A registers[instr->a]
+#define R_B registers[instr->b]
+#define R_C registers[instr->c]
+
+// --- Macro to predict the failing checks as unlikely
+#define FAILS(condition) __builtin_expect(!!(condition), 0)
+
+// --- Inline to write the cached state back to the machine data
+#define SAVE_STATE \
+    data->exec_p = (unsigned int) (instr - decoded); \
+    memcpy(data->registers, registers, sizeof(registers)); \
+    if(record != NULL) data->recorder.pos = (unsigned int) (record - data->recorder.entries);
+
+// --- Inline to reload the cached state from the machine data
+#define LOAD_STATE \
+    memcpy(registers, data->registers, sizeof(registers));
+
+// --- Inline to count the executed instructions since the last jump
+#define COUNT_STEPS(executed) \
+    data->stats.steps += (unsigned long long) (instr - block_start) + executed;
+
+// --- Inline to decode the command at the wanted index of table 0
+#define DECODE(index) \
+    command = (unsigned int) data->table_array[0]->content[index]; \
+    decoded[index].handler = handlers[(command >> COMMAND_SHIFT) & COMMAND_MASK]; \
+    decoded[index].a = (command >> A_SHIFT) & ARG_MASK; \
+    decoded[index].b = (command >> B_SHIFT) & ARG_MASK; \
+    decoded[index].c = (command >> C_SHIFT) & ARG_MASK; \
+    decoded[index].value = (int) command; \
+    if(((command >> COMMAND_SHIFT) & COMMAND_MASK) == 13) { \
+        decoded[index].a = (command >> A_SPEC_SHIFT) & ARG_MASK; \
+        decoded[index].value = (int) (command & DATA_MASK); \
+    }
+
+// --- Inline to decode the full table 0 and place the ending sentinel
+#define DECODE_ALL \
+    decoded_size = data->table_array[0]->size; \
+    decoded = (decoded_t *) realloc(decoded, (decoded_size + 1) * sizeof(decoded_t)); \
+    for(unsigned int i = 0 ; i < decoded_size ; i++) { \
+        DECODE(i) \
+    } \
+    decoded[decoded_size].handler = &&END;
+
+// --- Inline to check a table index and a plate index in it
+#define CHECK_ACCESS(table_index, plate_index) \
+    if(FAILS((unsigned int) (table_index) >= data->table_array_size || NO_TABLE(data->table_array[(unsigned int) (table_index)]))) goto TABLE_ERROR; \
+    if(FAILS((unsigned int) (plate_index) >= data->table_array[(unsigned int) (table_index)]->size)) goto PLATE_ERROR;
+
+// --- Inline for a conditional move
+#define DO_COND_MOVE \
+    if(R_C != 0) R_A = R_B;
+
+// --- Inline for a array index
+#define DO_ARRAY_INDEX \
+    CHECK_ACCESS(R_B, R_C) \
+    R_A = data->table_array[(unsigned int) R_B]->content[(unsigned int) R_C];
+
+// --- Inline for an array update (unshare the program if one of the shared tables
+// is modified and re-decode the command if table 0 is modified)
+#define DO_ARRAY_UPDATE \
+    CHECK_ACCESS(R_A, R_B) \
+    if((unsigned int) R_A == 0 || (unsigned int) R_A == data->shared_index) { \
+        unshare_program(data); \
+        data->table_array[(unsigned int) R_A]->content[(unsigned int) R_B] = R_C; \
+        if((unsigned int) R_A == 0) { \
+            save = R_B; \
+            DECODE((unsigned int) save) \
+        } \
+    } else { \
+        data->table_array[(unsigned int) R_A]->content[(unsigned int) R_B] = R_C; \
+    }
+
+// --- Inline for an addition
+#define DO_ADD \
+    R_A = R_B + R_C;
+
+// --- Inline for a multiplication
+#define DO_MULT \
+    R_A = R_B * R_C;
+
+// --- Inline for a division
+#define DO_DIV \
+    if(FAILS(R_C == 0)) goto DIVIDE_ERROR; \
+    R_A = (unsigned int) R_B / (unsigned int) R_C;
+
+// --- Inline for a nand
+#define DO_NAND \
+    R_A = ~(R_B & R_C);
+
+// --- Inline to stop the execution
+#define DO_STOP \
+    SAVE_STATE \
+    free(decoded); \
+    return;
+
+// --- Inline for a halt
+#define DO_HALT \
+    COUNT_STEPS(1) \
+    DO_STOP
+
+// --- Inline for a allocation (stop if a resource limit is reached)
+#define DO_ALLOC \
+    SAVE_STATE \
+    R_B = allocate_table(data, (unsigned int) R_C); \
+    if(FAILS(data->error->error_code != 0)) goto ALLOC_OVER_LIMIT;
+
+// --- Inline for a free
+#define DO_FREE \
+    if(FAILS((unsigned int) R_C >= data->table_array_size || R_C == 0)) goto FREE_BOUNDS_ERROR; \
+    if(FAILS(NO_TABLE(data->table_array[(unsigned int) R_C]))) goto FREE_NULL_ERROR; \
+    SAVE_STATE \
+    free_table(data, (unsigned int) R_C);
+
+// --- Inline for an output
+#define DO_OUTPUT \
+    if(FAILS((unsigned int) R_C > 255)) goto OUTPUT_RANGE_ERROR; \
+    OUTPUT_CHAR(data, R_C)
+
+// --- Inline for a char reader
+#define DO_INPUT \
+    flush_output(data); \
+    R_C = (int) INPUT_CHAR(data); \
+    if((char) R_C == '\n') R_C = -1;
+
+// --- Inline for a program loading (re-decode all if a new program is loaded, a
+// table already shared with table 0 is unmodified so the decoding is kept)
+#define DO_LOAD_PROG \
+    if(FAILS((unsigned int) R_B >= data->table_array_size || NO_TABLE(data->table_array[(unsigned int) R_B]))) goto TABLE_ERROR; \
+    if(FAILS((unsigned int) R_C >= data->table_array[(unsigned int) R_B]->size)) goto EXEC_POINTER_ERROR; \
+    COUNT_STEPS(1) \
+    save = R_C; \
+    if((unsigned int) R_B != 0 && (unsigned int) R_B != data->shared_index) { \
+        SAVE_STATE \
+        load_program(data, (unsigned int) R_B); \
+        DECODE_ALL \
+    } \
+    instr = decoded + (unsigned int) save; \
+    block_start = instr; \
+    if(SNAPSHOT_DUE(data)) { \
+        SAVE_STATE \
+        take_snapshot(data); \
+    } \
+    if(STEPS_EXCEEDED(data)) goto STEPS_OVER_LIMIT;
+
+// --- Inline for an ortho
+#define DO_ORTHO \
+    registers[instr->a] = instr->value;
+
+// --- Inline to record the current command and the value of its written register
+// before its execution, dump the recorder on a signal and stop on SIGINT
+#define DO_RECORD(word, written) \
+    record->exec_p = (unsigned int) (instr - decoded); \
+    record->command = (word); \
+    record->previous = (written); \
+    if(FAILS(++record == record_end)) { \
+        record = data->recorder.entries; \
+        data->recorder.full = 1; \
+    } \
+    if(FAILS(data->recorder.signal)) { \
+        SAVE_STATE \
+        check_recorder_signal(data); \
+        if(!(data->flags & RUNNING_FLAG)) { \
+            COUNT_STEPS(0) \
+            DO_STOP \
+        } \
+    }
+
+// --- Inline for the recording twin of a handler (the command word is kept in the
+// value of the decoded command, except for an ortho which is rebuilt)
+#define RECORDED(label, written) \
+    RECORD_##label: \
+        DO_RECORD((unsigned int) instr->value, written) \
+        goto label;
+
+#define RECORDED_ORTHO \
+    RECORD_ORTHO: \
+        DO_RECORD((13U << COMMAND_SHIFT) | ((unsigned int) instr->a << A_SPEC_SHIFT) | (unsigned int) instr->value, registers[instr->a]) \
+        goto ORTHO;
+
+// --- Inline to stop on an error with the failing command as execution pointer
+#define DO_ERROR(error_code, error_message) \
+    COUNT_STEPS(1) \
+    SAVE_STATE \
+    raise_machine_error(data, error_code, error_message); \
+    free(decoded); \
+    return;
+
+// --- Inline for jumping to the next instruction
+#define JUMP_NEXT \
+    instr++; \
+    goto *instr->handler;
+
+// --- Inline for jumping to the current instruction
+#define JUMP_CURRENT \
+    goto *instr->handler;
+
+// This structure represents a pre-decoded command
+typedef struct {
+    void *handler;
+    unsigned char a;
+    unsigned char b;
+    unsigned char c;
+    int value;
+} decoded_t;
+
+// --- Execute a command by dispatching it with all the checks
+void checked_execute(machine_data_t *data) {
+
+    // Declare the useful variables
+    int save;
+    unsigned int command;
+
+    // Cache the machine state in local variables
+    int registers[REGISTER_NUMBER];
+    LOAD_STATE
+
+    // Declare the label array
+    void *labels[] = {
+        &&COND_MOVE,
+        &&ARRAY_INDEX,
+        &&ARRAY_UPDATE,
+        &&ADD,
+        &&MULT,
+        &&DIV,
+        &&NAND,
+        &&HALT,
+        &&ALLOC,
+        &&FREE,
+        &&OUTPUT,
+        &&INPUT,
+        &&LOAD_PROG,
+        &&ORTHO,
+        &&UNKNOWN,
+        &&UNKNOWN
+    };
+
+    // Declare the recording label array
+    void *record_labels[] = {
+        &&RECORD_COND_MOVE,
+        &&RECORD_ARRAY_INDEX,
+        &&RECORD_ARRAY_UPDATE,
+        &&RECORD_ADD,
+        &&RECORD_MULT,
+        &&RECORD_DIV,
+        &&RECORD_NAND,
+        &&RECORD_HALT,
+        &&RECORD_ALLOC,
+        &&RECORD_FREE,
+        &&RECORD_OUTPUT,
+        &&RECORD_INPUT,
+        &&RECORD_LOAD_PROG,
+        &&RECORD_ORTHO,
+        &&RECORD_UNKNOWN,
+        &&RECORD_UNKNOWN
+    };
+    void **handlers = data->recorder.entries != NULL ? record_labels : labels;
+
+    // Cache the flight recorder position
+    recorder_entry_t *record = NULL;
+    recorder_entry_t *record_end = NULL;
+    if(data->recorder.entries != NULL) {
+        record = data->recorder.entries + data->recorder.pos;
+        record_end = data->recorder.entries + data->recorder.size;
+    }
+
+    // Decode the program and place the current instruction
+    decoded_t *decoded = NULL;
+    unsigned int decoded_size;
+    DECODE_ALL
+    decoded_t *instr = decoded + (data->exec_p < decoded_size ? data->exec_p : decoded_size);
+    decoded_t *block_start = instr;
+
+    // Start the first command
+    JUMP_CURRENT
+
+    // --- Labels for threaded execution
+
+    COND_MOVE: // Do a conditional move
+        DO_COND_MOVE
+        JUMP_NEXT
+
+    ARRAY_INDEX: // Do an array access
+        DO_ARRAY_INDEX
+        JUMP_NEXT
+
+    ARRAY_UPDATE: // Do an array update
+        DO_ARRAY_UPDATE
+        JUMP_NEXT
+
+    ADD: // Do an addition
+        DO_ADD
+        JUMP_NEXT
+
+    MULT: // Do a multiplication
+        DO_MULT
+        JUMP_NEXT
+
+    DIV: // Do a division
+        DO_DIV
+        JUMP_NEXT
+
+    NAND: // Do a not-and
+        DO_NAND
+        JUMP_NEXT
+
+    HALT: // Do an halt
+        DO_HALT
+
+    ALLOC: // Do a table allocation
+        DO_ALLOC
+        JUMP_NEXT
+
+    FREE: // Free a table
+        DO_FREE
+        JUMP_NEXT
+
+    OUTPUT: // Output a char in the console
+        DO_OUTPUT
+        JUMP_NEXT
+
+    INPUT: // Input a char in the console
+        DO_INPUT
+        JUMP_NEXT
+
+    LOAD_PROG: // Load a program
+        DO_LOAD_PROG
+        JUMP_CURRENT
+
+    ORTHO: // Load a value
+        DO_ORTHO
+        JUMP_NEXT
+
+    // --- Recording twins of the labels for the flight recorder
+
+    RECORDED(COND_MOVE, R_A)
+    RECORDED(ARRAY_INDEX, R_A)
+    RECORDED(ARRAY_UPDATE, R_A)
+    RECORDED(ADD, R_A)
+    RECORDED(MULT, R_A)
+    RECORDED(DIV, R_A)
+    RECORDED(NAND, R_A)
+    RECORDED(HALT, R_A)
+    RECORDED(ALLOC, R_B)
+    RECORDED(FREE, R_A)
+    RECORDED(OUTPUT, R_A)
+    RECORDED(INPUT, R_C)
+    RECORDED(LOAD_PROG, R_A)
+    RECORDED_ORTHO
+    RECORDED(UNKNOWN, R_A)
+
+    END: // Stop at the end of the program
+        COUNT_STEPS(0)
+        DO_STOP
+
+    // --- Labels for the errors, out of the execution path
+
+    UNKNOWN: // Stop on an unknown command
+        DO_ERROR(COMMAND_ERROR, "Unknown command")
+
+    TABLE_ERROR: // Stop on a bad table index
+        DO_ERROR(INDEX_OUT_OF_BOUNDS, "Tried to access a table out of bounds")
+
+    PLATE_ERROR: // Stop on a bad plate index
+        DO_ERROR(INDEX_OUT_OF_BOUNDS, "Tried to access a plate out of bounds")
+
+    EXEC_POINTER_ERROR: // Stop on a bad program loading index
+        DO_ERROR(INDEX_OUT_OF_BOUNDS, "Tried to place the execution pointer out of bounds")
+
+    DIVIDE_ERROR: // Stop on a division by zero
+        DO_ERROR(DIVIDE_BY_ZERO, "Tried to divide by 0, oh shi-")
+
+    FREE_BOUNDS_ERROR: // Stop on a free out of bounds
+        DO_ERROR(INDEX_OUT_OF_BOUNDS, "Tried to free a table out of bounds")
+
+    FREE_NULL_ERROR: // Stop on a free of a freed table
+        DO_ERROR(BAD_FREE_POINTER, "Tried to free a freed table")
+
+    OUTPUT_RANGE_ERROR: // Stop on an output out of the char range
+        DO_ERROR(OUTPUT_ERROR, "Tried to output a value not between 0 and 255")
+
+    STEPS_OVER_LIMIT: // Stop at a jump over the instruction limit (already counted)
+        SAVE_STATE
+        raise_machine_error(data, STEP_LIMIT_ERROR, "Reached the instruction limit");
+        free(decoded);
+        return;
+
+    ALLOC_OVER_LIMIT: // Stop on an allocation over a resource limit (already raised)
+        COUNT_STEPS(1)
+        free(decoded);
+        return;
+
+}
@@ -5,6 +5,10 @@
 #include "debug_executer.h"
 #include "machine.h"
 #include "utils.h"
+#include "io.h"
+#include "trace.h"
+#include "recorder.h"
+#include "snapshot.h"
 
 
 // ===== Functions to execute a bytecode safely =====
@@ -38,7 +42,7 @@ static void _do_array_index(machine_data_t *data, int a, int b, int c) {
     unsigned int r_c = data->registers[c];
 
     // Verify the table index
-    if(r_b < data->table_array_size) {
+    if(r_b < data->table_array_size && !NO_TABLE(data->table_array[r_b])) {
         // Verify the plate index
         if(r_c < data->table_array[r_b]->size) {
             data->registers[a] = data->table_array[r_b]->content[r_c];
@@ -57,9 +61,12 @@ static void _do_array_update(machine_data_t *data, int a, int b, int c) {
     int r_c = data->registers[c];
 
     // Verify the table index
-    if(r_a < data->table_array_size) {
+    if(r_a < data->table_array_size && !NO_TABLE(data->table_array[r_a])) {
         // Verify the plate index
         if(r_b < data->table_array[r_a]->size) {
+            if(r_a == 0 || r_a == data->shared_index) {
+                unshare_program(data);
+            }
             data->table_array[r_a]->content[r_b] = r_c;
         } else {
             raise_machine_error(data, INDEX_OUT_OF_BOUNDS, "Tried to access a plate out of bounds");
@@ -115,6 +122,9 @@ static void _do_allocation(machine_data_t *data, int b, int c) {
     unsigned int r_c = data->registers[c];
 
     unsigned int new_index = allocate_table(data, r_c);
+    if(data->error->error_code != 0) {
+        return;
+    }
     memset(data->table_array[new_index]->content, 0, data->table_array[new_index]->size * sizeof(int));
 
     data->registers[b] = new_index;
@@ -125,10 +135,10 @@ static void _do_free(machine_data_t *data, int c) {
     unsigned int r_c = data->registers[c];
 
     if(r_c < data->table_array_size && r_c > 0) {
-        if(data->table_array[r_c] != NULL) {
+        if(!NO_TABLE(data->table_array[r_c])) {
             free_table(data, r_c);
         } else {
-            raise_machine_error(data, BAD_FREE_POINTER, "Tried to free a NULL table");
+            raise_machine_error(data, BAD_FREE_POINTER, "Tried to free a freed table");
         }
     } else {
         raise_machine_error(data, INDEX_OUT_OF_BOUNDS, "Tried to free a table out of bounds");
@@ -140,7 +150,7 @@ static void _do_output(machine_data_t *data, int c) {
     int r_c = data->registers[c];
 
     if(r_c >= 0 && r_c <= 255) {
-        printf("%c", r_c);
+        OUTPUT_CHAR(data, r_c)
     } else {
         raise_machine_error(data, OUTPUT_ERROR, "Tried to output a value not between 0 and 255");
     }
@@ -148,7 +158,8 @@ static void _do_output(machine_data_t *data, int c) {
 
 // --- Do an input
 static void _do_input(machine_data_t *data, int c) {
-    char read = CHAR_READER();
+    flush_output(data);
+    char read = INPUT_CHAR(data);
 
     if(read == '\n') {
         data->registers[c] = -1;
@@ -163,23 +174,10 @@ static void _do_load_prog(machine_data_t *data, int b, int c) {
     unsigned int r_c = data->registers[c];
 
     // Check the table index
-    if(r_b < data->table_array_size) {
-
-        table_t *new_table;
-
-        // If the table index is 0, no need to copy the table
-        if(r_b != 0) {
-            new_table = (table_t *) malloc((data->table_array[r_b]->size + 1) * sizeof(int));
-            new_table->size = data->table_array[r_b]->size;
-            memcpy((void *) new_table->content, (void *) data->table_array[r_b]->content, new_table->size * sizeof(int));
-
-            free(data->table_array[0]);
-        } else {
-            new_table = data->table_array[0];
-        }
+    if(r_b < data->table_array_size && !NO_TABLE(data->table_array[r_b])) {
 
-        // Set the new command table
-        data->table_array[0] = new_table;
+        // Share the table with the program, it is copied on the first modification
+        load_program(data, r_b);
 
         // Check the new execution index
         if(r_c < data->table_array[0]->size) {
@@ -205,10 +203,11 @@ static void _do_ortho(machine_data_t *data, unsigned int command) {
 // --- Execute a command by dispatching it
 void debug_execute(machine_data_t *data) {
 
-    // Open the output file for the debug trace
-    FILE *exec_file = NULL;
+    // Open the binary trace file
+    trace_t trace;
+    char tracing = 0;
     if(data->flags & LOG_FLAG) {
-        exec_file = fopen(data->log_file, "w");
+        tracing = open_trace(&trace, data->log_file) == 0;
     }
 
     // Declare and get the three args and the command
@@ -219,10 +218,19 @@ void debug_execute(machine_data_t *data) {
 
         // Get the current command
         command = data->table_array[0]->content[data->exec_p];
+        data->stats.steps++;
 
         // Write the command and registers
-        if(exec_file != NULL) {
-            write_step(data, command, exec_file);
+        if(tracing) {
+            write_trace(&trace, data->exec_p, command, data->registers);
+        }
+
+        // Record the command and registers, dump them on a signal
+        if(data->recorder.entries != NULL) {
+            RECORD_STEP(data, data->exec_p, command, data->registers[WRITTEN_REGISTER(command)])
+            if(data->recorder.signal) {
+                check_recorder_signal(data);
+            }
         }
 
         // Get the three arguments
@@ -302,11 +310,21 @@ void debug_execute(machine_data_t *data) {
             data->exec_p++;
         }
 
+        // Take a snapshot between two commands if requested
+        if(SNAPSHOT_DUE(data)) {
+            take_snapshot(data);
+        }
+
+        // Stop over the instruction limit
+        if(STEPS_EXCEEDED(data)) {
+            raise_machine_error(data, STEP_LIMIT_ERROR, "Reached the instruction limit");
+        }
+
     }
 
-    // Close the execution file
-    if(exec_file != NULL) {
-        fclose(exec_file);
+    // Close the trace file
+    if(tracing) {
+        close_trace(&trace);
     }
 
 }
\ No newline at end of file
@@ -5,15 +5,89 @@
 #include "executer.h"
 #include "machine.h"
 #include "utils.h"
+#include "io.h"
+#include "snapshot.h"
 
 // ===== Functions and macros to execute the code unsafe but optimize =====
 
+// The registers are cached in local variables and only written back to the
+// machine data when the runtime needs them (halt, program loading, allocation,
+// free and errors)
+
+// Table 0 is pre-decoded into an array of decoded instructions (one per word
+// plus an ending sentinel) so the dispatch never extracts the fields again and
+// the execution pointer is a pointer in this array
+
+// The code is only left by a program loading, so the executed instructions are
+// counted from the jumps instead of on each instruction
+
+// The recurring idioms emitted by egcc (stack push and pop, 4-NAND equality,
+// conditional and direct jumps) are fused at decode time: the first command of
+// the sequence gets a superinstruction handler executing the whole sequence in
+// one dispatch, the next commands keep their own handlers so a jump can still
+// land in the middle of a sequence
+
 // --- Macro to get the registers
-#define COMMAND data->table_array[0]->content[data->exec_p]
-#define OP_CODE (COMMAND >> COMMAND_SHIFT) & COMMAND_MASK
-#define R_A data->registers[((COMMAND >> A_SHIFT) & ARG_MASK)]
-#define R_B data->registers[((COMMAND >> B_SHIFT) & ARG_MASK)]
-#define R_C data->registers[((COMMAND >> C_SHIFT) & ARG_MASK)]
+#define R_A registers[instr->a]
+#define R_B registers[instr->b]
+#define R_C registers[instr->c]
+
+// --- Inline to write the cached state back to the machine data
+#define SAVE_STATE \
+    data->exec_p = (unsigned int) (instr - decoded); \
+    memcpy(data->registers, registers, sizeof(registers));
+
+// --- Inline to reload the cached state from the machine data
+#define LOAD_STATE \
+    memcpy(registers, data->registers, sizeof(registers));
+
+// --- Inline to count the executed instructions since the last jump
+#define COUNT_STEPS(executed) \
+    data->stats.steps += (unsigned long long) (instr - block_start) + executed;
+
+// --- Macro to get the registers of the next commands in a fused sequence
+#define R_NEXT(offset, arg) registers[instr[offset].arg]
+
+// --- Number of commands a fusion can look ahead (longest fused sequence)
+#define FUSION_WINDOW 5
+
+// --- Inline to decode the command at the wanted index of table 0
+#define DECODE(index) \
+    command = (unsigned int) data->table_array[0]->content[index]; \
+    decoded[index].op = (command >> COMMAND_SHIFT) & COMMAND_MASK; \
+    decoded[index].handler = labels[decoded[index].op]; \
+    decoded[index].a = (command >> A_SHIFT) & ARG_MASK; \
+    decoded[index].b = (command >> B_SHIFT) & ARG_MASK; \
+    decoded[index].c = (command >> C_SHIFT) & ARG_MASK; \
+    if(((command >> COMMAND_SHIFT) & COMMAND_MASK) == 13) { \
+        decoded[index].a = (command >> A_SPEC_SHIFT) & ARG_MASK; \
+        decoded[index].value = (int) (command & DATA_MASK); \
+    }
+
+// --- Inline to select the handler of the command at the wanted index
+#define FUSE(index) \
+    fusion = _match_fusion(decoded + (index)); \
+    decoded[index].handler = fusion < 0 ? labels[decoded[index].op] : fused_labels[fusion];
+
+// --- Inline to break the fused sequences containing a re-decoded command (the
+// sequences created by a modification are only fused by the next full decoding)
+#define UNFUSE_AROUND(index) \
+    for(unsigned int i = (index) < FUSION_WINDOW - 1 ? 0 : (index) - FUSION_WINDOW + 1 ; i < (index) ; i++) { \
+        decoded[i].handler = labels[decoded[i].op]; \
+    }
+
+// --- Inline to decode the full table 0, place the ending sentinel and fuse
+#define DECODE_ALL \
+    decoded_size = data->table_array[0]->size; \
+    decoded = (decoded_t *) realloc(decoded, (decoded_size + 1) * sizeof(decoded_t)); \
+    for(unsigned int i = 0 ; i < decoded_size ; i++) { \
+        DECODE(i) \
+    } \
+    decoded[decoded_size].op = 14; \
+    decoded[decoded_size].handler = &&END; \
+    for(unsigned int i = 0 ; i < decoded_size ; i++) { \
+        FUSE(i) \
+    }
 
 // --- Inline for a conditional move
 #define DO_COND_MOVE \
@@ -23,9 +97,20 @@
 #define DO_ARRAY_INDEX \
     R_A = data->table_array[(unsigned int) R_B]->content[(unsigned int) R_C];
 
-// --- Inline for an array update
+// --- Inline for an array update (unshare the program if one of the shared tables
+// is modified and re-decode the command if table 0 is modified)
 #define DO_ARRAY_UPDATE \
-    data->table_array[(unsigned int) R_A]->content[(unsigned int) R_B] = R_C;
+    if((unsigned int) R_A == 0 || (unsigned int) R_A == data->shared_index) { \
+        unshare_program(data); \
+        data->table_array[(unsigned int) R_A]->content[(unsigned int) R_B] = R_C; \
+        if((unsigned int) R_A == 0) { \
+            save = R_B; \
+            DECODE((unsigned int) save) \
+            UNFUSE_AROUND((unsigned int) save) \
+        } \
+    } else { \
+        data->table_array[(unsigned int) R_A]->content[(unsigned int) R_B] = R_C; \
+    }
 
 // --- Inline for an addition
 #define DO_ADD \
@@ -43,55 +128,255 @@
 #define DO_NAND \
     R_A = ~(R_B & R_C);
 
+// --- Inline to stop the execution
+#define DO_STOP \
+    SAVE_STATE \
+    free(decoded); \
+    return;
+
+// --- Inline to take a requested snapshot at a jump and stop there if the
+// instruction limit is reached (every jump, fused or not, ends with it)
+#define CHECK_STEPS \
+    if(SNAPSHOT_DUE(data)) { \
+        SAVE_STATE \
+        take_snapshot(data); \
+    } \
+    if(STEPS_EXCEEDED(data)) { \
+        SAVE_STATE \
+        raise_machine_error(data, STEP_LIMIT_ERROR, "Reached the instruction limit"); \
+        free(decoded); \
+        return; \
+    }
+
 // --- Inline for a halt
 #define DO_HALT \
-    return;
+    COUNT_STEPS(1) \
+    DO_STOP
 
-// --- Inline for a allocation
+// --- Inline for a allocation (stop if a resource limit is reached)
 #define DO_ALLOC \
-    R_B = allocate_table(data, (unsigned int) R_C);
+    SAVE_STATE \
+    R_B = allocate_table(data, (unsigned int) R_C); \
+    if(__builtin_expect(data->error->error_code != 0, 0)) { \
+        COUNT_STEPS(1) \
+        free(decoded); \
+        return; \
+    }
 
 // --- Inline for a free
 #define DO_FREE \
+    SAVE_STATE \
     free_table(data, (unsigned int) R_C);
 
 // --- Inline for an output
 #define DO_OUTPUT \
-    printf("%c", R_C);
+    OUTPUT_CHAR(data, R_C)
 
 // --- Inline for a char reader
 #define DO_INPUT \
-    R_C = (int) CHAR_READER(); \
+    flush_output(data); \
+    R_C = (int) INPUT_CHAR(data); \
     if((char) R_C == '\n') R_C = -1;
 
-// --- Inline for a program loading
+// --- Inline for a program loading (re-decode all if a new program is loaded, a
+// table already shared with table 0 is unmodified so the decoding is kept)
 #define DO_LOAD_PROG \
+    COUNT_STEPS(1) \
     save = R_C; \
-    if((unsigned int) R_B != 0) { \
-        data->table_array[0] = realloc(data->table_array[0], (data->table_array[(unsigned int) R_B]->size + 1) * sizeof(int)); \
-        data->table_array[0]->size = data->table_array[(unsigned int) R_B]->size; \
-        memcpy((void *) data->table_array[0]->content, (void *) data->table_array[(unsigned int) R_B]->content, data->table_array[0]->size * sizeof(int)); \
+    if((unsigned int) R_B != 0 && (unsigned int) R_B != data->shared_index) { \
+        SAVE_STATE \
+        load_program(data, (unsigned int) R_B); \
+        DECODE_ALL \
     } \
-    data->exec_p = (unsigned int) save;
+    instr = decoded + (unsigned int) save; \
+    block_start = instr; \
+    CHECK_STEPS
 
 // --- Inline for an ortho
 #define DO_ORTHO \
-    data->registers[(int) ((COMMAND >> A_SPEC_SHIFT) & ARG_MASK)] = (int) (COMMAND & DATA_MASK);
+    registers[instr->a] = instr->value;
+
+// --- Inline for an unknown command
+#define DO_UNKNOWN \
+    COUNT_STEPS(1) \
+    SAVE_STATE \
+    raise_machine_error(data, COMMAND_ERROR, "Unknown command"); \
+    free(decoded); \
+    return;
+
+// --- Inline for a push (array update then increment of the index register), if
+// the update re-decoded the next command it is run unfused instead of the add
+#define DO_PUSH \
+    save = -1; \
+    DO_ARRAY_UPDATE \
+    if(__builtin_expect((unsigned int) save == (unsigned int) (instr - decoded) + 1, 0)) { \
+        JUMP_NEXT \
+    } \
+    R_NEXT(1, a) = R_NEXT(1, b) + R_NEXT(1, c); \
+    data->stats.fusions[FUSION_PUSH]++;
+
+// --- Inline for a pop (decrement of the index register then array index)
+#define DO_POP \
+    DO_ADD \
+    R_NEXT(1, a) = data->table_array[(unsigned int) R_NEXT(1, b)]->content[(unsigned int) R_NEXT(1, c)]; \
+    data->stats.fusions[FUSION_POP]++;
+
+// --- Inline for the 4-NAND equality (the difference bits end in the A register
+// of the last NAND)
+#define DO_EQUAL \
+    save = ~(R_B & R_C); \
+    R_A = save; \
+    R_B = ~(save & R_B); \
+    R_C = ~(save & R_C); \
+    R_B = ~(R_B & R_C); \
+    data->stats.fusions[FUSION_EQUAL]++;
+
+// --- Inline for a conditional jump (two label loads, conditional move, zero load
+// and program loading from table 0)
+#define DO_BRANCH \
+    R_NEXT(0, a) = instr[0].value; \
+    R_NEXT(1, a) = R_NEXT(2, c) != 0 ? instr[0].value : instr[1].value; \
+    R_NEXT(3, a) = 0; \
+    COUNT_STEPS(5) \
+    instr = decoded + (unsigned int) R_NEXT(1, a); \
+    block_start = instr; \
+    data->stats.fusions[FUSION_BRANCH]++; \
+    CHECK_STEPS
+
+// --- Inline for a direct jump (zero load, label load and program loading from
+// table 0)
+#define DO_JUMP \
+    R_NEXT(0, a) = 0; \
+    R_NEXT(1, a) = instr[1].value; \
+    COUNT_STEPS(3) \
+    instr = decoded + (unsigned int) R_NEXT(1, a); \
+    block_start = instr; \
+    data->stats.fusions[FUSION_JUMP]++; \
+    CHECK_STEPS
+
+// --- Inline for a conditional jump through a register already holding 0 (two
+// label loads, conditional move and program loading from table 0)
+#define DO_BRANCH_ZERO \
+    R_NEXT(0, a) = instr[0].value; \
+    R_NEXT(1, a) = R_NEXT(2, c) != 0 ? instr[0].value : instr[1].value; \
+    COUNT_STEPS(4) \
+    instr = decoded + (unsigned int) R_NEXT(1, a); \
+    block_start = instr; \
+    data->stats.fusions[FUSION_BRANCH_ZERO]++; \
+    CHECK_STEPS
+
+// --- Inline for a direct jump through a register already holding 0 (label load
+// and program loading from table 0)
+#define DO_JUMP_ZERO \
+    R_NEXT(0, a) = instr[0].value; \
+    COUNT_STEPS(2) \
+    instr = decoded + (unsigned int) R_NEXT(0, a); \
+    block_start = instr; \
+    data->stats.fusions[FUSION_JUMP_ZERO]++; \
+    CHECK_STEPS
 
 // --- Inline for jumping to the next instruction
 #define JUMP_NEXT \
-    data->exec_p++; \
-    goto *labels[OP_CODE];
+    instr++; \
+    goto *instr->handler;
+
+// --- Inline for jumping over a fused sequence
+#define JUMP_OVER(length) \
+    instr += length; \
+    goto *instr->handler;
 
 // --- Inline for jumping to the current instruction
 #define JUMP_CURRENT \
-    goto *labels[OP_CODE];
+    goto *instr->handler;
+
+// This structure represents a pre-decoded command
+typedef struct {
+    void *handler;
+    unsigned char op;
+    unsigned char a;
+    unsigned char b;
+    unsigned char c;
+    int value;
+} decoded_t;
+
+// --- Get the superinstruction starting at a decoded command (-1 if none), the
+// next commands are only read while the sequence matches so the ending
+// sentinel stops the matching
+static int _match_fusion(const decoded_t *instr) {
+
+    switch(instr[0].op) {
+
+    case 2: // ARRAY_UPDATE A B C + ADD B B D
+        if(instr[1].op == 3 && instr[1].a == instr[0].b && instr[1].b == instr[0].b) {
+            return FUSION_PUSH;
+        }
+        break;
+
+    case 3: // ADD A A B + ARRAY_INDEX C D A
+        if(instr[0].a == instr[0].b && instr[1].op == 1 && instr[1].c == instr[0].a) {
+            return FUSION_POP;
+        }
+        break;
+
+    case 6: // NAND T X Y + NAND X T X + NAND Y T Y + NAND X X Y
+        if(instr[0].a != instr[0].b && instr[0].a != instr[0].c && instr[0].b != instr[0].c &&
+            instr[1].op == 6 && instr[1].a == instr[0].b && instr[1].b == instr[0].a && instr[1].c == instr[0].b &&
+            instr[2].op == 6 && instr[2].a == instr[0].c && instr[2].b == instr[0].a && instr[2].c == instr[0].c &&
+            instr[3].op == 6 && instr[3].a == instr[0].b && instr[3].b == instr[0].b && instr[3].c == instr[0].c) {
+            return FUSION_EQUAL;
+        }
+        break;
+
+    case 13:
+        // ORTHO Z 0 + ORTHO Y L + LOAD_PROG Z Y
+        if(instr[0].value == 0 && instr[1].op == 13 && instr[1].a != instr[0].a &&
+            instr[2].op == 12 && instr[2].b == instr[0].a && instr[2].c == instr[1].a) {
+            return FUSION_JUMP;
+        }
+
+        // ORTHO X L1 + ORTHO Y L2 + COND_MOVE Y X C + ORTHO Z 0 + LOAD_PROG Z Y
+        if(instr[1].op == 13 && instr[1].a != instr[0].a &&
+            instr[2].op == 0 && instr[2].a == instr[1].a && instr[2].b == instr[0].a &&
+            instr[2].c != instr[0].a && instr[2].c != instr[1].a &&
+            instr[3].op == 13 && instr[3].value == 0 && instr[3].a != instr[1].a &&
+            instr[4].op == 12 && instr[4].b == instr[3].a && instr[4].c == instr[1].a) {
+            return FUSION_BRANCH;
+        }
+
+        // ORTHO X L1 + ORTHO Y L2 + COND_MOVE Y X C + LOAD_PROG Z Y (Z checked at runtime)
+        if(instr[1].op == 13 && instr[1].a != instr[0].a &&
+            instr[2].op == 0 && instr[2].a == instr[1].a && instr[2].b == instr[0].a &&
+            instr[2].c != instr[0].a && instr[2].c != instr[1].a &&
+            instr[3].op == 12 && instr[3].b != instr[0].a && instr[3].b != instr[1].a && instr[3].c == instr[1].a) {
+            return FUSION_BRANCH_ZERO;
+        }
+
+        // ORTHO Y L + LOAD_PROG Z Y (Z checked at runtime)
+        if(instr[1].op == 12 && instr[1].b != instr[0].a && instr[1].c == instr[0].a) {
+            return FUSION_JUMP_ZERO;
+        }
+        break;
+
+    default:
+        break;
+
+    }
+
+    return -1;
+
+}
 
 // --- Execute a command by dispatching it
 void execute(machine_data_t *data) {
 
     // Declare the useful variables
     int save;
+    int fusion;
+    unsigned int command;
+
+    // Cache the machine state in local variables
+    int registers[REGISTER_NUMBER];
+    LOAD_STATE
 
     // Declare the label array
     void *labels[] = {
@@ -108,11 +393,31 @@ void execute(machine_data_t *data) {
         &&OUTPUT,
         &&INPUT,
         &&LOAD_PROG,
-        &&ORTHO
+        &&ORTHO,
+        &&UNKNOWN,
+        &&UNKNOWN
     };
 
+    // Declare the superinstruction label array
+    void *fused_labels[] = {
+        &&PUSH,
+        &&POP,
+        &&EQUAL,
+        &&BRANCH,
+        &&JUMP,
+        &&BRANCH_ZERO,
+        &&JUMP_ZERO
+    };
+
+    // Decode the program and place the current instruction
+    decoded_t *decoded = NULL;
+    unsigned int decoded_size;
+    DECODE_ALL
+    decoded_t *instr = decoded + data->exec_p;
+    decoded_t *block_start = instr;
+
     // Start the first command
-    goto *labels[OP_CODE];
+    JUMP_CURRENT
 
     // --- Labels for threaded execution
 
@@ -171,4 +476,41 @@ void execute(machine_data_t *data) {
         DO_ORTHO
         JUMP_NEXT
 
-}
\ No newline at end of file
+    PUSH: // Do a fused stack push
+        DO_PUSH
+        JUMP_OVER(2)
+
+    POP: // Do a fused stack pop
+        DO_POP
+        JUMP_OVER(2)
+
+    EQUAL: // Do a fused 4-NAND equality
+        DO_EQUAL
+        JUMP_OVER(4)
+
+    BRANCH: // Do a fused conditional jump
+        DO_BRANCH
+        JUMP_CURRENT
+
+    JUMP: // Do a fused direct jump
+        DO_JUMP
+        JUMP_CURRENT
+
+    BRANCH_ZERO: // Do a fused conditional jump if the table register holds 0, else run it unfused
+        if(R_NEXT(3, b) != 0) goto ORTHO;
+        DO_BRANCH_ZERO
+        JUMP_CURRENT
+
+    JUMP_ZERO: // Do a fused direct jump if the table register holds 0, else run it unfused
+        if(R_NEXT(1, b) != 0) goto ORTHO;
+        DO_JUMP_ZERO
+        JUMP_CURRENT
+
+    UNKNOWN: // Stop on an unknown command
+        DO_UNKNOWN
+
+    END: // Stop at the end of the program
+        COUNT_STEPS(0)
+        DO_STOP
+
+}
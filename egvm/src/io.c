@@ -0,0 +1,94 @@
+#include <unistd.h>
+
+#include "io.h"
+#include "machine.h"
+
+// OS specific imports
+#ifdef EG_UNIX
+    #include <termios.h>
+#elif EG_WINDOWS
+    // Do Windows imports
+#elif EG_MAC
+    // Do MacOS imports
+#endif
+
+
+// ===== Functions to handle the machine input and output =====
+
+// The terminal is configured once when the input is initialized and restored
+// when it is cleaned, the input is then read by blocks in a buffer
+
+// --- File variables
+#ifdef EG_UNIX
+static struct termios _old_term;
+static char _term_changed = 0;
+#endif
+
+// --- Initialize the output buffer on the wanted file descriptor
+void init_output(machine_data_t *data, int fd) {
+    data->output_fd = fd;
+    data->output_size = 0;
+}
+
+// --- Write all the buffered output
+void flush_output(machine_data_t *data) {
+
+    // Write until the buffer is empty or the file descriptor fails
+    unsigned int written = 0;
+    while(written < data->output_size) {
+        ssize_t res = write(data->output_fd, data->output_buffer + written, data->output_size - written);
+        if(res <= 0) {
+            break;
+        }
+        written += res;
+    }
+
+    data->output_size = 0;
+
+}
+
+// --- Initialize the input buffer and configure the terminal if needed
+void init_input(machine_data_t *data, int fd) {
+    data->input_fd = fd;
+    data->input_size = 0;
+    data->input_pos = 0;
+
+#ifdef EG_UNIX
+    // Disable the line buffering of the terminal
+    if(isatty(fd) && !_term_changed) {
+        struct termios new_term;
+        tcgetattr(fd, &_old_term);
+        new_term = _old_term;
+        new_term.c_lflag &= ~(ICANON);
+        tcsetattr(fd, TCSANOW, &new_term);
+        _term_changed = 1;
+    }
+#endif
+}
+
+// --- Restore the terminal configuration
+void clean_input(machine_data_t *data) {
+#ifdef EG_UNIX
+    if(_term_changed) {
+        tcsetattr(data->input_fd, TCSANOW, &_old_term);
+        _term_changed = 0;
+    }
+#endif
+}
+
+// --- Read a new block of input and return its first char (-1 at the end of the input)
+char fill_input(machine_data_t *data) {
+
+    // Read as many chars as available in the buffer
+    ssize_t res = read(data->input_fd, data->input_buffer, INPUT_BUFFER_SIZE);
+    if(res <= 0) {
+        data->input_size = 0;
+        data->input_pos = 0;
+        return (char) -1;
+    }
+
+    data->input_size = res;
+    data->input_pos = 1;
+    return data->input_buffer[0];
+
+}
@@ -0,0 +1,545 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "jit.h"
+#include "machine.h"
+#include "utils.h"
+#include "io.h"
+#include "executer.h"
+
+// OS specific imports
+#ifdef EG_UNIX
+    #include <sys/mman.h>
+#endif
+
+
+// ===== Functions to compile the program to x86-64 native code =====
+
+// Table 0 is compiled block by block, a block ends on a program loading, a halt
+// or a command that needs the runtime (allocation, free, input, output). The
+// 8 machine registers are pinned to r8d-r15d, rdi holds the machine data and
+// rsi the JIT state during the native execution
+
+// A LOAD_PROG from table 0 is done in native code through the block table, the
+// other block ends leave the native code with a reason and the C dispatcher
+// does the work before entering the next block
+
+// An ARRAY_UPDATE into a compiled address of table 0 or into a shared table
+// leaves the native code, the runtime does it and flushes the whole cache if
+// a compiled command was modified
+
+#if defined(__x86_64__) && defined(EG_UNIX)
+
+// --- Host registers numbers
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RSP 4
+#define RBP 5
+#define RSI 6
+#define RDI 7
+#define NO_INDEX 4
+
+// --- Get the host register of a machine register
+#define HOST(reg) (8 + (reg))
+
+// --- Offsets of the data used by the native code
+#define DATA_REGISTERS offsetof(machine_data_t, registers)
+#define DATA_EXEC_P offsetof(machine_data_t, exec_p)
+#define DATA_TABLE_ARRAY offsetof(machine_data_t, table_array)
+#define DATA_SHARED_INDEX offsetof(machine_data_t, shared_index)
+#define DATA_STEPS (offsetof(machine_data_t, stats) + offsetof(machine_stats_t, steps))
+#define DATA_MAX_STEPS offsetof(machine_data_t, max_steps)
+#define TABLE_CONTENT offsetof(table_t, content)
+#define JIT_BLOCKS offsetof(jit_state_t, blocks)
+#define JIT_SIZE offsetof(jit_state_t, size)
+#define JIT_REASON offsetof(jit_state_t, reason)
+#define JIT_COVERED offsetof(jit_state_t, covered)
+
+// --- Maximum number of exits to the runtime for one command
+#define JIT_PENDING_MAX 3
+
+// --- Condition codes for the conditional jumps
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_AE 0x3
+
+// This structure represents an exit of a block waiting to be emitted
+typedef struct {
+    unsigned char *patch;
+    unsigned int exec_p;
+    unsigned int steps;
+} pending_exit_t;
+
+// --- Internal function declarations
+static void _emit_byte(jit_state_t *jit, unsigned char byte);
+static void _emit_int(jit_state_t *jit, int value);
+static void _emit_opcode(jit_state_t *jit, int w, int opcode, int reg, int index, int base);
+static void _emit_rr(jit_state_t *jit, int w, int opcode, int reg, int rm);
+static void _emit_rm(jit_state_t *jit, int w, int opcode, int reg, int base, int index, int scale, int disp);
+static void _emit_mov_imm(jit_state_t *jit, int reg, int value);
+static void _emit_push(jit_state_t *jit, int reg);
+static void _emit_pop(jit_state_t *jit, int reg);
+static unsigned char *_emit_jcc(jit_state_t *jit, int cc);
+static unsigned char *_emit_jmp(jit_state_t *jit);
+static void _patch(unsigned char *patch, unsigned char *target);
+static void _add_pending(pending_exit_t *pending, unsigned int *pending_size, unsigned char *patch, unsigned int exec_p, unsigned int steps);
+static void _emit_steps(jit_state_t *jit, unsigned int steps);
+static void _emit_exit(jit_state_t *jit, int reason, unsigned int exec_p, unsigned int steps);
+static void _emit_chain(jit_state_t *jit, unsigned int exec_p, unsigned int steps);
+static void _emit_stubs(jit_state_t *jit);
+static void _flush(jit_state_t *jit, unsigned int size);
+static void *_compile_block(machine_data_t *data, jit_state_t *jit, unsigned int start);
+static int _run_command(machine_data_t *data, jit_state_t *jit);
+
+// --- Emit a byte in the cache
+static void _emit_byte(jit_state_t *jit, unsigned char byte) {
+    *jit->cache_p++ = byte;
+}
+
+// --- Emit a 32 bits integer in the cache
+static void _emit_int(jit_state_t *jit, int value) {
+    memcpy(jit->cache_p, &value, sizeof(int));
+    jit->cache_p += sizeof(int);
+}
+
+// --- Emit the REX prefix if needed and the opcode (one byte or 0x0F prefixed)
+static void _emit_opcode(jit_state_t *jit, int w, int opcode, int reg, int index, int base) {
+    int rex = (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+    if(rex != 0) {
+        _emit_byte(jit, 0x40 | rex);
+    }
+    if(opcode > 0xFF) {
+        _emit_byte(jit, opcode >> 8);
+    }
+    _emit_byte(jit, opcode & 0xFF);
+}
+
+// --- Emit an instruction with a register operand and a register r/m operand
+static void _emit_rr(jit_state_t *jit, int w, int opcode, int reg, int rm) {
+    _emit_opcode(jit, w, opcode, reg, 0, rm);
+    _emit_byte(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// --- Emit an instruction with a register operand and a [base + index * scale + disp] operand
+static void _emit_rm(jit_state_t *jit, int w, int opcode, int reg, int base, int index, int scale, int disp) {
+    _emit_opcode(jit, w, opcode, reg, index, base);
+    _emit_byte(jit, 0x80 | ((reg & 7) << 3) | 4);
+    _emit_byte(jit, (scale << 6) | ((index & 7) << 3) | (base & 7));
+    _emit_int(jit, disp);
+}
+
+// --- Emit a move of an immediate in a 32 bits register
+static void _emit_mov_imm(jit_state_t *jit, int reg, int value) {
+    if(reg >= 8) {
+        _emit_byte(jit, 0x41);
+    }
+    _emit_byte(jit, 0xB8 + (reg & 7));
+    _emit_int(jit, value);
+}
+
+// --- Emit a push of a 64 bits register
+static void _emit_push(jit_state_t *jit, int reg) {
+    if(reg >= 8) {
+        _emit_byte(jit, 0x41);
+    }
+    _emit_byte(jit, 0x50 + (reg & 7));
+}
+
+// --- Emit a pop of a 64 bits register
+static void _emit_pop(jit_state_t *jit, int reg) {
+    if(reg >= 8) {
+        _emit_byte(jit, 0x41);
+    }
+    _emit_byte(jit, 0x58 + (reg & 7));
+}
+
+// --- Emit a conditional jump and return the address to patch
+static unsigned char *_emit_jcc(jit_state_t *jit, int cc) {
+    _emit_byte(jit, 0x0F);
+    _emit_byte(jit, 0x80 | cc);
+    unsigned char *res = jit->cache_p;
+    _emit_int(jit, 0);
+    return res;
+}
+
+// --- Emit an unconditional jump and return the address to patch
+static unsigned char *_emit_jmp(jit_state_t *jit) {
+    _emit_byte(jit, 0xE9);
+    unsigned char *res = jit->cache_p;
+    _emit_int(jit, 0);
+    return res;
+}
+
+// --- Patch a jump to go to the target
+static void _patch(unsigned char *patch, unsigned char *target) {
+    int rel = (int) (target - (patch + sizeof(int)));
+    memcpy(patch, &rel, sizeof(int));
+}
+
+// --- Add an exit to the runtime to emit at the end of the block
+static void _add_pending(pending_exit_t *pending, unsigned int *pending_size, unsigned char *patch, unsigned int exec_p, unsigned int steps) {
+    pending[*pending_size].patch = patch;
+    pending[*pending_size].exec_p = exec_p;
+    pending[*pending_size].steps = steps;
+    (*pending_size)++;
+}
+
+// --- Emit the addition of the executed instructions to the statistics
+static void _emit_steps(jit_state_t *jit, unsigned int steps) {
+    if(steps > 0) {
+        _emit_rm(jit, 1, 0x81, 0, RDI, NO_INDEX, 0, DATA_STEPS);
+        _emit_int(jit, steps);
+    }
+}
+
+// --- Emit an exit of the native code
+static void _emit_exit(jit_state_t *jit, int reason, unsigned int exec_p, unsigned int steps) {
+    _emit_steps(jit, steps);
+    _emit_rm(jit, 0, 0xC7, 0, RDI, NO_INDEX, 0, DATA_EXEC_P);
+    _emit_int(jit, exec_p);
+    _emit_rm(jit, 0, 0xC7, 0, RSI, NO_INDEX, 0, JIT_REASON);
+    _emit_int(jit, reason);
+    _patch(_emit_jmp(jit), jit->exit);
+}
+
+// --- Emit a jump to the block of a known address (or an exit if not compiled yet)
+static void _emit_chain(jit_state_t *jit, unsigned int exec_p, unsigned int steps) {
+    _emit_steps(jit, steps);
+
+    // Get the block address and jump to it if it exists
+    _emit_rm(jit, 1, 0x8B, RAX, RSI, NO_INDEX, 0, JIT_BLOCKS);
+    _emit_rm(jit, 1, 0x8B, RAX, RAX, NO_INDEX, 0, exec_p * sizeof(void *));
+    _emit_rr(jit, 1, 0x85, RAX, RAX);
+    unsigned char *not_compiled = _emit_jcc(jit, CC_E);
+    _emit_rr(jit, 0, 0xFF, 4, RAX);
+
+    _patch(not_compiled, jit->cache_p);
+    _emit_exit(jit, JIT_EXIT_JUMP, exec_p, 0);
+}
+
+// --- Emit the native code entry and exit at the cache start
+static void _emit_stubs(jit_state_t *jit) {
+
+    int saved[] = {RBX, RBP, 12, 13, 14, 15};
+
+    // Entry : enter(data, jit, block), save the callee saved registers and load the machine registers
+    jit->enter = jit->cache_p;
+    for(int i = 0 ; i < 6 ; i++) {
+        _emit_push(jit, saved[i]);
+    }
+    for(int i = 0 ; i < REGISTER_NUMBER ; i++) {
+        _emit_rm(jit, 0, 0x8B, HOST(i), RDI, NO_INDEX, 0, DATA_REGISTERS + i * sizeof(int));
+    }
+    _emit_rr(jit, 0, 0xFF, 4, RDX);
+
+    // Exit : store the machine registers and restore the callee saved registers
+    jit->exit = jit->cache_p;
+    for(int i = 0 ; i < REGISTER_NUMBER ; i++) {
+        _emit_rm(jit, 0, 0x89, HOST(i), RDI, NO_INDEX, 0, DATA_REGISTERS + i * sizeof(int));
+    }
+    for(int i = 5 ; i >= 0 ; i--) {
+        _emit_pop(jit, saved[i]);
+    }
+    _emit_byte(jit, 0xC3);
+
+    jit->blocks_start = jit->cache_p;
+
+}
+
+// --- Forget all the compiled blocks and resize the block table to the program size
+static void _flush(jit_state_t *jit, unsigned int size) {
+
+    jit->cache_p = jit->blocks_start;
+    jit->size = size;
+    jit->blocks = (void **) realloc(jit->blocks, (size + 1) * sizeof(void *));
+    jit->covered = (unsigned char *) realloc(jit->covered, size + 1);
+    memset(jit->blocks, 0, (size + 1) * sizeof(void *));
+    memset(jit->covered, 0, size + 1);
+
+}
+
+// --- Compile the block starting at the wanted address and return its entry
+static void *_compile_block(machine_data_t *data, jit_state_t *jit, unsigned int start) {
+
+    // Flush the cache if there is not enough space for a full block
+    if(jit->cache_end - jit->cache_p < JIT_BLOCK_MAX * JIT_INSTR_MAX_SIZE) {
+        _flush(jit, jit->size);
+    }
+
+    unsigned char *entry = jit->cache_p;
+    pending_exit_t pending[JIT_BLOCK_MAX * JIT_PENDING_MAX];
+    unsigned int pending_size = 0;
+    unsigned int *code = (unsigned int *) data->table_array[0]->content;
+    unsigned int exec_p = start;
+    unsigned int steps = 0;
+    char ended = 0;
+
+    while(!ended) {
+
+        // Chain to the next block at the end of the program or if the block is too long
+        if(exec_p >= jit->size || steps >= JIT_BLOCK_MAX) {
+            _emit_chain(jit, exec_p, steps);
+            break;
+        }
+
+        unsigned int command = code[exec_p];
+        int a = HOST(get_arg_a(command));
+        int b = HOST(get_arg_b(command));
+        int c = HOST(get_arg_c(command));
+        unsigned char *patch;
+        jit->covered[exec_p] = 1;
+
+        switch(get_command(command)) {
+
+        case 0: // Conditional move
+            _emit_rr(jit, 0, 0x85, c, c);
+            _emit_rr(jit, 0, 0x0F45, a, b);
+            break;
+
+        case 1: // Array index
+            _emit_rm(jit, 1, 0x8B, RCX, RDI, NO_INDEX, 0, DATA_TABLE_ARRAY);
+            _emit_rr(jit, 0, 0x89, b, RAX);
+            _emit_rm(jit, 1, 0x8B, RCX, RCX, RAX, 3, 0);
+            _emit_rr(jit, 0, 0x89, c, RAX);
+            _emit_rm(jit, 0, 0x8B, a, RCX, RAX, 2, TABLE_CONTENT);
+            break;
+
+        case 2: // Array update, leave the native code if a compiled command may be modified
+            _emit_rr(jit, 0, 0x89, a, RAX);
+            _emit_rr(jit, 0, 0x85, RAX, RAX);
+            patch = _emit_jcc(jit, CC_E);
+            _emit_rm(jit, 0, 0x3B, RAX, RDI, NO_INDEX, 0, DATA_SHARED_INDEX);
+            _add_pending(pending, &pending_size, _emit_jcc(jit, CC_E), exec_p, steps);
+            _emit_rm(jit, 1, 0x8B, RCX, RDI, NO_INDEX, 0, DATA_TABLE_ARRAY);
+            _emit_rm(jit, 1, 0x8B, RCX, RCX, RAX, 3, 0);
+            _emit_rr(jit, 0, 0x89, b, RAX);
+            _emit_rm(jit, 0, 0x89, c, RCX, RAX, 2, TABLE_CONTENT);
+            unsigned char *updated = _emit_jmp(jit);
+
+            // Update in table 0 if it is not shared and the address is not compiled
+            _patch(patch, jit->cache_p);
+            _emit_rm(jit, 0, 0x81, 7, RDI, NO_INDEX, 0, DATA_SHARED_INDEX);
+            _emit_int(jit, 0);
+            _add_pending(pending, &pending_size, _emit_jcc(jit, CC_NE), exec_p, steps);
+            _emit_rr(jit, 0, 0x89, b, RAX);
+            _emit_rm(jit, 0, 0x3B, RAX, RSI, NO_INDEX, 0, JIT_SIZE);
+            _add_pending(pending, &pending_size, _emit_jcc(jit, CC_AE), exec_p, steps);
+            _emit_rm(jit, 1, 0x8B, RCX, RSI, NO_INDEX, 0, JIT_COVERED);
+            _emit_rm(jit, 0, 0x80, 7, RCX, RAX, 0, 0);
+            _emit_byte(jit, 0);
+            _add_pending(pending, &pending_size, _emit_jcc(jit, CC_NE), exec_p, steps);
+            _emit_rm(jit, 1, 0x8B, RCX, RDI, NO_INDEX, 0, DATA_TABLE_ARRAY);
+            _emit_rm(jit, 1, 0x8B, RCX, RCX, NO_INDEX, 0, 0);
+            _emit_rm(jit, 0, 0x89, c, RCX, RAX, 2, TABLE_CONTENT);
+            _patch(updated, jit->cache_p);
+            break;
+
+        case 3: // Add
+            _emit_rr(jit, 0, 0x89, b, RAX);
+            _emit_rr(jit, 0, 0x01, c, RAX);
+            _emit_rr(jit, 0, 0x89, RAX, a);
+            break;
+
+        case 4: // Multiply
+            _emit_rr(jit, 0, 0x89, b, RAX);
+            _emit_rr(jit, 0, 0x0FAF, RAX, c);
+            _emit_rr(jit, 0, 0x89, RAX, a);
+            break;
+
+        case 5: // Divide
+            _emit_rr(jit, 0, 0x89, b, RAX);
+            _emit_rr(jit, 0, 0x31, RDX, RDX);
+            _emit_rr(jit, 0, 0xF7, 6, c);
+            _emit_rr(jit, 0, 0x89, RAX, a);
+            break;
+
+        case 6: // Not and
+            _emit_rr(jit, 0, 0x89, b, RAX);
+            _emit_rr(jit, 0, 0x21, c, RAX);
+            _emit_rr(jit, 0, 0xF7, 2, RAX);
+            _emit_rr(jit, 0, 0x89, RAX, a);
+            break;
+
+        case 7: // Halt
+            _emit_exit(jit, JIT_EXIT_HALT, exec_p, steps + 1);
+            ended = 1;
+            break;
+
+        case 12: // Load prog, jump in native code if the program is not changed
+            _emit_rr(jit, 0, 0x85, b, b);
+            _add_pending(pending, &pending_size, _emit_jcc(jit, CC_NE), exec_p, steps);
+            _emit_steps(jit, steps + 1);
+            _emit_rr(jit, 0, 0x89, c, RAX);
+            _emit_rm(jit, 1, 0x8B, RCX, RDI, NO_INDEX, 0, DATA_STEPS);
+            _emit_rm(jit, 1, 0x3B, RCX, RDI, NO_INDEX, 0, DATA_MAX_STEPS);
+            unsigned char *over_limit = _emit_jcc(jit, CC_AE);
+            _emit_rm(jit, 0, 0x3B, RAX, RSI, NO_INDEX, 0, JIT_SIZE);
+            unsigned char *out_of_program = _emit_jcc(jit, CC_AE);
+            _emit_rm(jit, 1, 0x8B, RCX, RSI, NO_INDEX, 0, JIT_BLOCKS);
+            _emit_rm(jit, 1, 0x8B, RCX, RCX, RAX, 3, 0);
+            _emit_rr(jit, 1, 0x85, RCX, RCX);
+            patch = _emit_jcc(jit, CC_E);
+            _emit_rr(jit, 0, 0xFF, 4, RCX);
+
+            // Leave the native code to compile the target block or to stop over the instruction limit
+            _patch(over_limit, jit->cache_p);
+            _patch(out_of_program, jit->cache_p);
+            _patch(patch, jit->cache_p);
+            _emit_rm(jit, 0, 0x89, RAX, RDI, NO_INDEX, 0, DATA_EXEC_P);
+            _emit_rm(jit, 0, 0xC7, 0, RSI, NO_INDEX, 0, JIT_REASON);
+            _emit_int(jit, JIT_EXIT_JUMP);
+            _patch(_emit_jmp(jit), jit->exit);
+            ended = 1;
+            break;
+
+        case 13: // Ortho
+            _emit_mov_imm(jit, HOST(get_special_a(command)), get_special_value(command));
+            break;
+
+        default: // Allocation, free, output, input and unknown commands are done by the runtime
+            _emit_exit(jit, JIT_EXIT_RUNTIME, exec_p, steps);
+            ended = 1;
+            break;
+
+        }
+
+        exec_p++;
+        steps++;
+
+    }
+
+    // Emit the exits to the runtime of the block
+    for(unsigned int i = 0 ; i < pending_size ; i++) {
+        _patch(pending[i].patch, jit->cache_p);
+        _emit_exit(jit, JIT_EXIT_RUNTIME, pending[i].exec_p, pending[i].steps);
+    }
+
+    jit->blocks[start] = entry;
+    return entry;
+
+}
+
+// --- Execute the command at the execution pointer in the runtime, return 1 to stop
+static int _run_command(machine_data_t *data, jit_state_t *jit) {
+
+    unsigned int command = data->table_array[0]->content[data->exec_p];
+    int *r_a = &data->registers[get_arg_a(command)];
+    int *r_b = &data->registers[get_arg_b(command)];
+    int *r_c = &data->registers[get_arg_c(command)];
+
+    data->stats.steps++;
+
+    switch(get_command(command)) {
+
+    case 2: // Array update in a compiled command or in a shared table
+        unshare_program(data);
+        data->table_array[(unsigned int) *r_a]->content[(unsigned int) *r_b] = *r_c;
+        if((unsigned int) *r_a == 0 && (unsigned int) *r_b < jit->size && jit->covered[(unsigned int) *r_b]) {
+            _flush(jit, jit->size);
+        }
+        break;
+
+    case 8: // Allocate
+        *r_b = allocate_table(data, (unsigned int) *r_c);
+        if(data->error->error_code != 0) {
+            return 1;
+        }
+        break;
+
+    case 9: // Free
+        free_table(data, (unsigned int) *r_c);
+        break;
+
+    case 10: // Output
+        OUTPUT_CHAR(data, *r_c)
+        break;
+
+    case 11: // Input
+        flush_output(data);
+        *r_c = (int) INPUT_CHAR(data);
+        if((char) *r_c == '\n') *r_c = -1;
+        break;
+
+    case 12: // Load a new program and forget the compiled one (kept if the table is already shared with table 0)
+        if((unsigned int) *r_b != data->shared_index) {
+            load_program(data, (unsigned int) *r_b);
+            _flush(jit, data->table_array[0]->size);
+        }
+        data->exec_p = (unsigned int) *r_c;
+        return 0;
+
+    default:
+        raise_machine_error(data, COMMAND_ERROR, "Unknown command");
+        return 1;
+
+    }
+
+    data->exec_p++;
+    return 0;
+
+}
+
+// --- Compile the program to native code while executing it
+void jit_execute(machine_data_t *data) {
+
+    // Map the code cache, use the interpreter if it is not possible
+    jit_state_t jit;
+    jit.cache = (unsigned char *) mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(jit.cache == MAP_FAILED) {
+        execute(data);
+        return;
+    }
+    jit.cache_p = jit.cache;
+    jit.cache_end = jit.cache + JIT_CACHE_SIZE;
+    jit.blocks = NULL;
+    jit.covered = NULL;
+    _emit_stubs(&jit);
+    _flush(&jit, data->table_array[0]->size);
+
+    void (*enter)(machine_data_t *, jit_state_t *, void *) = (void (*)(machine_data_t *, jit_state_t *, void *)) jit.enter;
+
+    // Execute the blocks until the halt, an error or the end of the program
+    while(data->exec_p < jit.size) {
+
+        // Stop over the instruction limit, the native jumps leave the code once it is reached
+        if(STEPS_EXCEEDED(data)) {
+            raise_machine_error(data, STEP_LIMIT_ERROR, "Reached the instruction limit");
+            break;
+        }
+
+        // Get the block or compile it
+        void *block = jit.blocks[data->exec_p];
+        if(block == NULL) {
+            block = _compile_block(data, &jit, data->exec_p);
+        }
+
+        // Execute the native code and handle the exit
+        enter(data, &jit, block);
+        if(jit.reason == JIT_EXIT_HALT) {
+            break;
+        }
+        if(jit.reason == JIT_EXIT_RUNTIME && _run_command(data, &jit)) {
+            break;
+        }
+
+    }
+
+    // Free the JIT memory
+    munmap(jit.cache, JIT_CACHE_SIZE);
+    free(jit.blocks);
+    free(jit.covered);
+
+}
+
+#else
+
+// --- Execute the program with the interpreter on the other architectures
+void jit_execute(machine_data_t *data) {
+    execute(data);
+}
+
+#endif
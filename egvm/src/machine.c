@@ -1,11 +1,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "machine.h"
 #include "utils.h"
+#include "allocator.h"
+#include "io.h"
 #include "executer.h"
 #include "debug_executer.h"
+#include "profile_executer.h"
+#include "checked_executer.h"
+#include "jit.h"
+#include "recorder.h"
+#include "snapshot.h"
+
+// OS specific imports
+#ifdef EG_UNIX
+    #include <sys/resource.h>
+#endif
 
 
 // ===== Functions to manipulate the machine =====
@@ -13,6 +26,7 @@
 // --- Function declarations
 static void _double_table_array(machine_data_t *data);
 static void _clean_up(machine_data_t *data);
+static void _print_statistics(machine_data_t *data);
 
 // --- Double the table collection size
 static void _double_table_array(machine_data_t *data) {
@@ -28,25 +42,75 @@ static void _clean_up(machine_data_t *data) {
     // Set all freelist to null
     table_t **freel = data->free_start;
     while (freel != NULL) {
-        table_t **next = (table_t **) *freel;
+        table_t **next = FREE_NEXT(freel);
         *freel = NULL;
         freel = next;
     }
     data->free_start = NULL;
 
+    // Avoid a double free if the program is shared
+    if(data->shared_index != 0) {
+        data->table_array[0] = NULL;
+    }
+
     // Clean the table array
     for(unsigned int i = 0 ; i < data->table_array_size ; i++) {
         if(data->table_array[i] != NULL) {
-            free(data->table_array[i]);
+            delete_table(data, data->table_array[i]);
         }
     }
     free(data->table_array);
 
+    // Clean the allocator
+    clean_allocator(data);
+
+}
+
+// --- Print the execution statistics on the error output
+static void _print_statistics(machine_data_t *data) {
+
+    machine_stats_t *stats = &data->stats;
+
+    fprintf(stderr, "Statistics :\n");
+    fprintf(stderr, "    instructions : %llu\n", stats->steps);
+    fprintf(stderr, "    load_time : %.6f\n", stats->load_time);
+    fprintf(stderr, "    exec_time : %.6f\n", stats->exec_time);
+    fprintf(stderr, "    mips : %.2f\n", stats->exec_time > 0 ? (double) stats->steps / stats->exec_time / 1e6 : 0.0);
+    fprintf(stderr, "    allocations : %llu\n", stats->allocations);
+    fprintf(stderr, "    frees : %llu\n", stats->frees);
+    fprintf(stderr, "    peak_tables : %u\n", stats->peak_tables);
+    fprintf(stderr, "    fused_push : %llu\n", stats->fusions[FUSION_PUSH]);
+    fprintf(stderr, "    fused_pop : %llu\n", stats->fusions[FUSION_POP]);
+    fprintf(stderr, "    fused_equal : %llu\n", stats->fusions[FUSION_EQUAL]);
+    fprintf(stderr, "    fused_branch : %llu\n", stats->fusions[FUSION_BRANCH]);
+    fprintf(stderr, "    fused_jump : %llu\n", stats->fusions[FUSION_JUMP]);
+    fprintf(stderr, "    fused_branch_zero : %llu\n", stats->fusions[FUSION_BRANCH_ZERO]);
+    fprintf(stderr, "    fused_jump_zero : %llu\n", stats->fusions[FUSION_JUMP_ZERO]);
+
+#ifdef EG_UNIX
+    // Get the peak resident memory of the process
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "    peak_rss_kib : %ld\n", usage.ru_maxrss);
+#endif
+
 }
 
-// --- Function to allocate a new plate table and return its index
+// --- Function to allocate a new plate table and return its index (0 with a
+// machine error if a resource limit is reached)
 unsigned int allocate_table(machine_data_t *data, unsigned int size) {
 
+    // Refuse the allocation over the resource limits
+    unsigned long long memory = (unsigned long long) size * sizeof(int);
+    if(__builtin_expect(data->stats.live_tables >= data->max_tables, 0)) {
+        raise_machine_error(data, TABLE_LIMIT_ERROR, "Reached the live table limit");
+        return 0;
+    }
+    if(__builtin_expect(data->stats.live_memory + memory > data->max_memory, 0)) {
+        raise_machine_error(data, MEMORY_LIMIT_ERROR, "Reached the memory limit");
+        return 0;
+    }
+
     // Prepare the new index
     unsigned int new_table_index;
 
@@ -54,7 +118,7 @@ unsigned int allocate_table(machine_data_t *data, unsigned int size) {
     if(data->free_start != NULL) {
 
         new_table_index = (unsigned int) (data->free_start - data->table_array);
-        data->free_start = (table_t **) *data->free_start;
+        data->free_start = FREE_NEXT(data->free_start);
 
     } else {
 
@@ -70,8 +134,15 @@ unsigned int allocate_table(machine_data_t *data, unsigned int size) {
     }
 
     // Create a new table and increase the size
-    data->table_array[new_table_index] = (table_t *) calloc(size + 1, sizeof(int));
-    data->table_array[new_table_index]->size = size;
+    data->table_array[new_table_index] = new_table(data, size);
+
+    // Update the statistics
+    data->stats.allocations++;
+    data->stats.live_tables++;
+    data->stats.live_memory += memory;
+    if(data->stats.live_tables > data->stats.peak_tables) {
+        data->stats.peak_tables = data->stats.live_tables;
+    }
 
     return new_table_index;
 
@@ -80,7 +151,17 @@ unsigned int allocate_table(machine_data_t *data, unsigned int size) {
 // --- Function to free a plate table
 void free_table(machine_data_t *data, unsigned int index) {
 
-    free(data->table_array[index]);
+    // Update the statistics
+    data->stats.frees++;
+    data->stats.live_tables--;
+
+    // If the table is shared with the program, the program keeps its memory
+    if(index == data->shared_index) {
+        data->shared_index = 0;
+    } else {
+        data->stats.live_memory -= (unsigned long long) data->table_array[index]->size * sizeof(int);
+        delete_table(data, data->table_array[index]);
+    }
     data->table_array[index] = NULL;
 
     if(index == data->table_array_size - 1) {
@@ -91,18 +172,68 @@ void free_table(machine_data_t *data, unsigned int index) {
     } else {
         
         // Update the free list
-        data->table_array[index] = (table_t *) data->free_start;
+        data->table_array[index] = FREE_LINK(data->free_start);
         data->free_start = &data->table_array[index];
 
     }
 
 }
 
+// --- Function to load a table as the program, the memory is shared until one of them is modified
+void load_program(machine_data_t *data, unsigned int index) {
+
+    // Nothing to do if the table is already the program
+    if(index == 0 || index == data->shared_index) {
+        return;
+    }
+
+    // Stop counting the current program, a shared image is counted as the program
+    // memory too but it is not freed
+    if(data->shared_index == 0 || data->shared_index == SHARED_IMAGE) {
+        data->stats.live_memory -= (unsigned long long) data->table_array[0]->size * sizeof(int);
+    }
+
+    // Free the current program only if it owns its memory
+    if(data->shared_index == 0) {
+        delete_table(data, data->table_array[0]);
+    }
+
+    // Share the table memory with the program
+    data->table_array[0] = data->table_array[index];
+    data->shared_index = index;
+
+}
+
+// --- Function to give the program its own copy of a shared table before a modification
+void unshare_program(machine_data_t *data) {
+
+    // Nothing to do if the program owns its memory
+    if(data->shared_index == 0) {
+        return;
+    }
+
+    // Copy the shared table in a new program table (a shared image is already
+    // counted as the program memory)
+    table_t *shared = data->table_array[0];
+    if(data->shared_index != SHARED_IMAGE) {
+        data->stats.live_memory += (unsigned long long) shared->size * sizeof(int);
+    }
+    data->table_array[0] = new_table(data, shared->size);
+    memcpy((void *) data->table_array[0]->content, (void *) shared->content, shared->size * sizeof(int));
+    data->shared_index = 0;
+
+}
+
 // --- Function to raise an execution error
 void raise_machine_error(machine_data_t *data, int error_code, char *error_message) {
     data->error->error_code = error_code;
     data->error->error_offset = data->exec_p;
     data->error->error_message = error_message;
+
+    // Dump the commands leading to the error
+    if(data->recorder.entries != NULL) {
+        dump_recorder(data);
+    }
 }
 
 // --- Main function of the machine
@@ -116,17 +247,86 @@ void run_machine(machine_data_t *data) {
     data->table_array_size = 1;
     data->table_array_cap = 1;
     data->free_start = NULL;
-
-    // Read the binary file, get its code and initialise the code pointer
+    data->shared_index = 0;
+    init_allocator(data);
+    init_output(data, data->output_fd);
+    init_input(data, data->input_fd);
+    memset(&data->stats, 0, sizeof(machine_stats_t));
+    data->stats.live_tables = 1;
+    data->stats.peak_tables = 1;
+
+    // Read the binary file or the snapshot, get its code and initialise the code pointer
+    double load_start = get_time();
     data->table_array = (table_t **) malloc(sizeof(table_t *));
-    data->table_array[0] = read_egb_file(data->egb_file_name);
+    if(data->restore_file != NULL) {
+        if(restore_snapshot(data, data->restore_file)) {
+            data->table_array[0] = NULL;
+            raise_machine_error(data, SNAPSHOT_ERROR, "Cannot restore the snapshot");
+        }
+    } else if(data->program_image != NULL) {
+        // Use the read-only image as the program, it is copied on the first modification
+        data->table_array[0] = (table_t *) data->program_image;
+        data->shared_index = SHARED_IMAGE;
+    } else {
+        data->table_array[0] = read_egb_file(data, data->egb_file_name);
+        if(data->table_array[0] == NULL) {
+            raise_machine_error(data, FILE_ERROR, "Cannot read the bytecode file");
+        }
+    }
+
+    data->stats.load_time = get_time() - load_start;
+    if(data->restore_file == NULL && data->table_array[0] != NULL) {
+        data->stats.live_memory = (unsigned long long) data->table_array[0]->size * sizeof(int);
+    }
+
+    // Report the loading time in verbose mode
+    if(data->flags & VERBOSE_FLAG && data->table_array[0] != NULL) {
+        fprintf(stderr, "Loaded %u instructions in %.3f ms\n", data->table_array[0]->size, data->stats.load_time * 1000);
+    }
+
+    // Prepare the snapshots
+    if(data->snapshot_file != NULL) {
+        init_snapshot(data);
+    }
 
     // Execute the code in the wanted mode
-    if(data->flags & DEBUG_FLAG) {
-        debug_execute(data);
+    double exec_start = get_time();
+    if(data->error->error_code != 0) {
+        // Nothing to execute
+    } else if(data->flags & (DEBUG_FLAG | CHECKED_FLAG | RECORDER_FLAG)) {
+        // The flight recorder runs in the checked mode unless the debug mode is wanted
+        if(data->flags & RECORDER_FLAG) {
+            init_recorder(data);
+        }
+        if(data->flags & DEBUG_FLAG) {
+            debug_execute(data);
+        } else {
+            checked_execute(data);
+        }
+        if(data->flags & RECORDER_FLAG) {
+            clean_recorder(data);
+        }
+    } else if(data->flags & PROFILE_FLAG) {
+        profile_execute(data);
+    } else if(data->flags & JIT_FLAG) {
+        jit_execute(data);
     } else {
         execute(data);
     }
+    data->stats.exec_time = get_time() - exec_start;
+
+    if(data->snapshot_file != NULL) {
+        clean_snapshot(data);
+    }
+
+    // Write the remaining output and restore the input
+    flush_output(data);
+    clean_input(data);
+
+    // Display the statistics if needed
+    if(data->flags & STATS_FLAG) {
+        _print_statistics(data);
+    }
 
     // Clean up the table array
     _clean_up(data);
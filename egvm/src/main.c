@@ -1,10 +1,14 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "main.h"
 #include "utils.h"
 #include "machine.h"
+#include "recorder.h"
+#include "snapshot.h"
+#include "server.h"
 
 
 // ===== Main functions =====
@@ -29,11 +33,127 @@ int _parse_args(int argc, char *argv[], machine_data_t *data) {
                 data->flags |= DEBUG_FLAG;
             } else
 
-            // Get the log flag
+            // Get the help flag
             if(strcmp("-h", current_arg) == 0) {
                 data->flags |= HELP_FLAG;
             }
 
+            // Get the checked flag
+            if(strcmp("-c", current_arg) == 0) {
+                data->flags |= CHECKED_FLAG;
+            }
+
+            // Get the JIT flag
+            if(strcmp("-j", current_arg) == 0) {
+                data->flags |= JIT_FLAG;
+            }
+
+            // Get the profiling flag
+            if(strcmp("-p", current_arg) == 0) {
+                data->flags |= PROFILE_FLAG;
+            }
+
+            // Get the statistics flag
+            if(strcmp("-s", current_arg) == 0) {
+                data->flags |= STATS_FLAG;
+            }
+
+            // Get the verbose flag
+            if(strcmp("-v", current_arg) == 0) {
+                data->flags |= VERBOSE_FLAG;
+            }
+
+            // Get the output buffering mode
+            if(strcmp("-b", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                if(strcmp("line", argv[i]) == 0) {
+                    data->flags |= LINE_OUTPUT_FLAG;
+                } else if(strcmp("full", argv[i]) == 0) {
+                    data->flags &= ~LINE_OUTPUT_FLAG;
+                } else {
+                    printf("\"%s\" : Unknown buffering mode\n", argv[i]);
+                    return 1;
+                }
+            }
+
+            // Get the table allocator
+            if(strcmp("-a", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                if(strcmp("malloc", argv[i]) == 0) {
+                    data->flags &= ~SLAB_FLAG;
+                } else if(strcmp("slab", argv[i]) == 0) {
+                    data->flags |= SLAB_FLAG;
+                } else {
+                    printf("\"%s\" : Unknown allocator\n", argv[i]);
+                    return 1;
+                }
+            }
+
+            // Get the snapshot file and instruction count
+            if(strcmp("--snapshot", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                data->snapshot_file = argv[i];
+            }
+            if(strcmp("--snapshot-at", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                data->snapshot_at = strtoull(argv[i], NULL, 10);
+            }
+
+            // Get the resource limits (the memory limit takes a K, M or G suffix)
+            if(strcmp("--max-steps", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                data->max_steps = strtoull(argv[i], NULL, 10);
+            }
+            if(strcmp("--max-tables", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                data->max_tables = strtoull(argv[i], NULL, 10);
+            }
+            if(strcmp("--max-memory", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                char *unit;
+                data->max_memory = strtoull(argv[i], &unit, 10);
+                if(*unit == 'K' || *unit == 'k') {
+                    data->max_memory <<= 10;
+                } else if(*unit == 'M' || *unit == 'm') {
+                    data->max_memory <<= 20;
+                } else if(*unit == 'G' || *unit == 'g') {
+                    data->max_memory <<= 30;
+                } else if(*unit != '\0') {
+                    printf("\"%s\" : Unknown memory size\n", argv[i]);
+                    return 1;
+                }
+            }
+
+            // Get the server socket and its number of workers
+            if(strcmp("--server", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                data->server_socket = argv[i];
+            }
+            if(strcmp("--workers", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                data->server_workers = (unsigned int) atoi(argv[i]);
+            }
+
+            // Get the snapshot to restore
+            if(strcmp("--restore", current_arg) == 0 && i + 1 < argc) {
+                i++;
+                data->restore_file = argv[i];
+            }
+
+            // Get the flight recorder flag and its size (only a purely numeric argument
+            // is a size, so a file name starting with digits stays the bytecode file)
+            if(strcmp("-r", current_arg) == 0) {
+                data->flags |= RECORDER_FLAG;
+                if(i + 1 < argc) {
+                    char *end;
+                    unsigned long size = strtoul(argv[i + 1], &end, 10);
+                    if(argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9' && *end == '\0' && size > 0 && size <= 0xFFFFFFFFUL) {
+                        i++;
+                        data->recorder.size = (unsigned int) size;
+                    }
+                }
+            }
+
             // Get the log flag
             if(strcmp("-l", current_arg) == 0) {
                 data->flags |= LOG_FLAG;
@@ -47,8 +167,33 @@ int _parse_args(int argc, char *argv[], machine_data_t *data) {
         }
     }
 
+    // The server gets the bytecode files from its jobs
+    if(data->server_socket != NULL) {
+        if(data->server_workers == 0) {
+            data->server_workers = (unsigned int) sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        if(data->server_workers == 0 || data->server_workers > SERVER_WORKERS_MAX) {
+            data->server_workers = data->server_workers == 0 ? 1 : SERVER_WORKERS_MAX;
+        }
+        return 0;
+    }
+
+    // A restored machine is named after its snapshot
+    if(data->egb_file_name == NULL) {
+        data->egb_file_name = data->restore_file;
+    }
+    if(data->egb_file_name == NULL) {
+        printf("No bytecode file given (see -h)\n");
+        return 1;
+    }
+
+    // Snapshot at the wanted instruction count in the default file
+    if(data->snapshot_at != SNAPSHOT_NEVER && data->snapshot_file == NULL) {
+        data->snapshot_file = change_extension(data->egb_file_name, "snap");
+    }
+
     if(data->flags & LOG_FLAG) {
-        data->log_file = change_extension(data->egb_file_name, ".exec");
+        data->log_file = change_extension(data->egb_file_name, "trace");
     }
 
     return 0;
@@ -59,11 +204,29 @@ int _parse_args(int argc, char *argv[], machine_data_t *data) {
 static void _display_help() {
     printf("egvm : The earl grey virtual machine, base on the universal machine\n");
     printf("Version : %s\n\n", EGVM_VERSION);
-    printf("Usage : egvm [OPTIONS] <FILE.egb>\n\n");
+    printf("Usage : egvm [OPTIONS] <FILE.egb>\n");
+    printf("        egvm [OPTIONS] --restore <FILE.snap>\n");
+    printf("        egvm [OPTIONS] --server <SOCKET>\n\n");
     printf("Options :\n");
+    printf("    -a <malloc|slab> : Select the table allocator (default : slab)\n");
+    printf("    -b <line|full> : Select the output buffering (default : line on a terminal, else full)\n");
+    printf("    -c : Enable the checked mode (Execute the bytecode safely with the fast dispatch)\n");
     printf("    -d : Enable the debug mode (Execute the bytecode safely)\n");
     printf("    -h : Display this help menu\n");
-    printf("    -l : Enable the logging mode !!! Works only in debug mode !!! (Save all instructions read in a file)\n");
+    printf("    -j : Enable the JIT mode (Compile the bytecode to x86-64 native code)\n");
+    printf("    -l : Enable the logging mode !!! Works only in debug mode !!! (Save a binary trace of all instructions read, see egtrace)\n");
+    printf("    -p : Enable the profiling mode (Display the executions per opcode and address at the end)\n");
+    printf("    -r [size] : Enable the flight recorder in the checked mode, or in the debug mode with -d (Keep the last commands, %d by default, and write them on an error, SIGUSR1 or SIGINT, see egtrace)\n", RECORDER_DEFAULT_SIZE);
+    printf("    -s : Display the execution statistics at the end\n");
+    printf("    -v : Enable the verbose mode (Display the loading time)\n");
+    printf("    --snapshot <file> : Write the machine state in the file on SIGUSR2 !!! Not in JIT and profiling modes !!!\n");
+    printf("    --snapshot-at <count> : Write the machine state at the first jump after <count> instructions (default file : FILE.snap)\n");
+    printf("    --restore <file> : Resume the machine from a snapshot instead of a bytecode file\n");
+    printf("    --max-steps <count> : Stop with an error at the first jump after <count> instructions\n");
+    printf("    --max-tables <count> : Stop with an error on an allocation over <count> live tables (program included)\n");
+    printf("    --max-memory <size> : Stop with an error on an allocation over <size> bytes of tables (program included, K, M or G suffix)\n");
+    printf("    --server <socket> : Run the jobs received on a Unix socket (bytecode path and new line, then the input) in the checked mode !!! With -j a bad program crashes the server and all the running jobs !!!\n");
+    printf("    --workers <number> : Select the number of worker threads of the server (default : number of CPUs)\n");
 }
 
 // --- The main function to start the interpretation
@@ -79,7 +242,25 @@ int main(int argc, char *argv[]) {
     data.error = &error;
     data.flags = 0;
     data.flags |= RUNNING_FLAG;
+    data.flags |= SLAB_FLAG;
+    if(isatty(STDOUT_FILENO)) {
+        data.flags |= LINE_OUTPUT_FLAG;
+    }
     data.flags &= ~SKIP_SHIFT_FLAG;
+    data.recorder.entries = NULL;
+    data.recorder.size = 0;
+    data.egb_file_name = NULL;
+    data.snapshot_file = NULL;
+    data.restore_file = NULL;
+    data.snapshot_at = SNAPSHOT_NEVER;
+    data.max_steps = NO_LIMIT;
+    data.max_tables = NO_LIMIT;
+    data.max_memory = NO_LIMIT;
+    data.program_image = NULL;
+    data.server_socket = NULL;
+    data.server_workers = 0;
+    data.input_fd = STDIN_FILENO;
+    data.output_fd = STDOUT_FILENO;
 
     // Parse the arguments
     if(_parse_args(argc, argv, &data)) {
@@ -92,8 +273,13 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    // Run the server mode
+    if(data.server_socket != NULL) {
+        return run_server(&data);
+    }
+
     // Check if the bytecode file exists
-    if(access(data.egb_file_name, F_OK)) {
+    if(data.restore_file == NULL && access(data.egb_file_name, F_OK)) {
         printf("\"%s\" : File not found\n", data.egb_file_name);
         return 1;
     }
@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile_executer.h"
+#include "machine.h"
+#include "utils.h"
+#include "io.h"
+
+
+// ===== Functions and macros to execute the code while profiling it =====
+
+// This is a copy of the threaded execution that counts the executions of each
+// opcode and each address and measures the time spent in the runtime calls,
+// so the normal execution pays nothing for the profiling
+
+// This structure represents a hot address in the report
+typedef struct {
+    unsigned int address;
+    unsigned long long count;
+} hot_address_t;
+
+// This structure contains the profiling counters
+typedef struct {
+    unsigned long long opcode_counts[16];
+    unsigned long long *address_counts;
+    unsigned int address_size;
+    unsigned long long reloads;
+    unsigned long long runtime_calls[3];
+    double runtime_times[3];
+} profile_t;
+
+// --- Indexes of the timed runtime calls
+#define ALLOC_CALL 0
+#define FREE_CALL 1
+#define LOAD_PROG_CALL 2
+
+// --- Internal function declarations
+static void _resize_address_counts(profile_t *profile, unsigned int size);
+static int _compare_hot_addresses(const void *first, const void *second);
+static void _print_profile(machine_data_t *data, profile_t *profile);
+
+// --- Macro to get the registers
+#define COMMAND code[exec_p]
+#define OP_CODE ((COMMAND >> COMMAND_SHIFT) & COMMAND_MASK)
+#define R_A registers[((COMMAND >> A_SHIFT) & ARG_MASK)]
+#define R_B registers[((COMMAND >> B_SHIFT) & ARG_MASK)]
+#define R_C registers[((COMMAND >> C_SHIFT) & ARG_MASK)]
+
+// --- Inline to write the cached state back to the machine data
+#define SAVE_STATE \
+    data->exec_p = exec_p; \
+    memcpy(data->registers, registers, sizeof(registers));
+
+// --- Inline to start and stop the timing of a runtime call
+#define START_TIMER \
+    call_start = get_time();
+
+#define STOP_TIMER(call) \
+    profile.runtime_calls[call]++; \
+    profile.runtime_times[call] += get_time() - call_start;
+
+// --- Inline for a conditional move
+#define DO_COND_MOVE \
+    if(R_C != 0) R_A = R_B;
+
+// --- Inline for a array index
+#define DO_ARRAY_INDEX \
+    R_A = data->table_array[(unsigned int) R_B]->content[(unsigned int) R_C];
+
+// --- Inline for an array update (unshare the program if one of the shared tables is modified)
+#define DO_ARRAY_UPDATE \
+    if((unsigned int) R_A == 0 || (unsigned int) R_A == data->shared_index) { \
+        unshare_program(data); \
+        code = (unsigned int *) data->table_array[0]->content; \
+    } \
+    data->table_array[(unsigned int) R_A]->content[(unsigned int) R_B] = R_C;
+
+// --- Inline for an addition
+#define DO_ADD \
+    R_A = R_B + R_C;
+
+// --- Inline for a multiplication
+#define DO_MULT \
+    R_A = R_B * R_C;
+
+// --- Inline for a division
+#define DO_DIV \
+    R_A = (unsigned int) R_B / (unsigned int) R_C;
+
+// --- Inline for a nand
+#define DO_NAND \
+    R_A = ~(R_B & R_C);
+
+// --- Inline to stop the execution
+#define DO_STOP \
+    SAVE_STATE \
+    _print_profile(data, &profile); \
+    free(profile.address_counts); \
+    return;
+
+// --- Inline for a allocation
+#define DO_ALLOC \
+    SAVE_STATE \
+    START_TIMER \
+    R_B = allocate_table(data, (unsigned int) R_C); \
+    STOP_TIMER(ALLOC_CALL) \
+    if(data->error->error_code != 0) { \
+        DO_STOP \
+    }
+
+// --- Inline for a free
+#define DO_FREE \
+    SAVE_STATE \
+    START_TIMER \
+    free_table(data, (unsigned int) R_C); \
+    STOP_TIMER(FREE_CALL)
+
+// --- Inline for an output
+#define DO_OUTPUT \
+    OUTPUT_CHAR(data, R_C)
+
+// --- Inline for a char reader
+#define DO_INPUT \
+    flush_output(data); \
+    R_C = (int) INPUT_CHAR(data); \
+    if((char) R_C == '\n') R_C = -1;
+
+// --- Inline for a program loading (nothing to reload if the table is already
+// shared with table 0)
+#define DO_LOAD_PROG \
+    save = R_C; \
+    if((unsigned int) R_B != 0 && (unsigned int) R_B != data->shared_index) { \
+        SAVE_STATE \
+        START_TIMER \
+        load_program(data, (unsigned int) R_B); \
+        code = (unsigned int *) data->table_array[0]->content; \
+        _resize_address_counts(&profile, data->table_array[0]->size); \
+        profile.reloads++; \
+        STOP_TIMER(LOAD_PROG_CALL) \
+    } \
+    exec_p = (unsigned int) save; \
+    if(STEPS_EXCEEDED(data)) { \
+        SAVE_STATE \
+        raise_machine_error(data, STEP_LIMIT_ERROR, "Reached the instruction limit"); \
+        DO_STOP \
+    }
+
+// --- Inline for an ortho
+#define DO_ORTHO \
+    registers[(int) ((COMMAND >> A_SPEC_SHIFT) & ARG_MASK)] = (int) (COMMAND & DATA_MASK);
+
+// --- Inline for an unknown command
+#define DO_UNKNOWN \
+    SAVE_STATE \
+    raise_machine_error(data, COMMAND_ERROR, "Unknown command"); \
+    DO_STOP
+
+// --- Inline for jumping to the current instruction and count it
+#define JUMP_CURRENT \
+    if(exec_p >= data->table_array[0]->size) goto END; \
+    data->stats.steps++; \
+    profile.opcode_counts[OP_CODE]++; \
+    profile.address_counts[exec_p]++; \
+    goto *labels[OP_CODE];
+
+// --- Inline for jumping to the next instruction
+#define JUMP_NEXT \
+    exec_p++; \
+    JUMP_CURRENT
+
+// --- Grow the address counters to the wanted program size
+static void _resize_address_counts(profile_t *profile, unsigned int size) {
+    if(size > profile->address_size) {
+        profile->address_counts = (unsigned long long *) realloc(profile->address_counts, size * sizeof(unsigned long long));
+        memset(profile->address_counts + profile->address_size, 0, (size - profile->address_size) * sizeof(unsigned long long));
+        profile->address_size = size;
+    }
+}
+
+// --- Compare two hot addresses to sort them by decreasing count
+static int _compare_hot_addresses(const void *first, const void *second) {
+    unsigned long long first_count = ((const hot_address_t *) first)->count;
+    unsigned long long second_count = ((const hot_address_t *) second)->count;
+    return (first_count < second_count) - (first_count > second_count);
+}
+
+// --- Print the profiling report on the error output
+static void _print_profile(machine_data_t *data, profile_t *profile) {
+
+    double total = data->stats.steps > 0 ? (double) data->stats.steps : 1.0;
+
+    fprintf(stderr, "Profile :\n");
+    fprintf(stderr, "    instructions : %llu\n", data->stats.steps);
+    fprintf(stderr, "    table 0 reloads : %llu\n", profile->reloads);
+    fprintf(stderr, "    ALLOC time : %.6f s (%llu calls)\n", profile->runtime_times[ALLOC_CALL], profile->runtime_calls[ALLOC_CALL]);
+    fprintf(stderr, "    FREE time : %.6f s (%llu calls)\n", profile->runtime_times[FREE_CALL], profile->runtime_calls[FREE_CALL]);
+    fprintf(stderr, "    LOAD time : %.6f s (%llu calls)\n", profile->runtime_times[LOAD_PROG_CALL], profile->runtime_calls[LOAD_PROG_CALL]);
+
+    // Sort the opcodes by decreasing count
+    hot_address_t opcodes[16];
+    for(unsigned int i = 0 ; i < 16 ; i++) {
+        opcodes[i].address = i;
+        opcodes[i].count = profile->opcode_counts[i];
+    }
+    qsort(opcodes, 16, sizeof(hot_address_t), _compare_hot_addresses);
+
+    fprintf(stderr, "\n    Opcodes :\n");
+    for(unsigned int i = 0 ; i < 16 && opcodes[i].count > 0 ; i++) {
+        fprintf(stderr, "        %s : %llu (%.2f %%)\n", get_command_name(opcodes[i].address), opcodes[i].count, opcodes[i].count * 100.0 / total);
+    }
+
+    // Sort the executed addresses by decreasing count
+    hot_address_t *hot = (hot_address_t *) malloc(profile->address_size * sizeof(hot_address_t) + 1);
+    unsigned int hot_size = 0;
+    for(unsigned int i = 0 ; i < profile->address_size ; i++) {
+        if(profile->address_counts[i] > 0) {
+            hot[hot_size].address = i;
+            hot[hot_size].count = profile->address_counts[i];
+            hot_size++;
+        }
+    }
+    qsort(hot, hot_size, sizeof(hot_address_t), _compare_hot_addresses);
+
+    fprintf(stderr, "\n    Hot addresses :\n");
+    for(unsigned int i = 0 ; i < hot_size && i < PROFILE_HOT_NUMBER ; i++) {
+        fprintf(stderr, "        %08x : %llu (%.2f %%)", hot[i].address, hot[i].count, hot[i].count * 100.0 / total);
+        if(hot[i].address < data->table_array[0]->size) {
+            fprintf(stderr, "\t%s", get_command_name(get_command(data->table_array[0]->content[hot[i].address])));
+        }
+        fprintf(stderr, "\n");
+    }
+
+    free(hot);
+
+}
+
+// --- Execute the program and count the executed instructions
+void profile_execute(machine_data_t *data) {
+
+    // Declare the useful variables
+    int save;
+    double call_start;
+
+    // Cache the machine state in local variables
+    unsigned int exec_p = data->exec_p;
+    unsigned int *code = (unsigned int *) data->table_array[0]->content;
+    int registers[REGISTER_NUMBER];
+    memcpy(registers, data->registers, sizeof(registers));
+
+    // Prepare the profiling counters
+    profile_t profile;
+    memset(&profile, 0, sizeof(profile_t));
+    _resize_address_counts(&profile, data->table_array[0]->size);
+
+    // Declare the label array
+    void *labels[] = {
+        &&COND_MOVE,
+        &&ARRAY_INDEX,
+        &&ARRAY_UPDATE,
+        &&ADD,
+        &&MULT,
+        &&DIV,
+        &&NAND,
+        &&HALT,
+        &&ALLOC,
+        &&FREE,
+        &&OUTPUT,
+        &&INPUT,
+        &&LOAD_PROG,
+        &&ORTHO,
+        &&UNKNOWN,
+        &&UNKNOWN
+    };
+
+    // Start the first command
+    JUMP_CURRENT
+
+    // --- Labels for threaded execution
+
+    COND_MOVE: // Do a conditional move
+        DO_COND_MOVE
+        JUMP_NEXT
+
+    ARRAY_INDEX: // Do an array access
+        DO_ARRAY_INDEX
+        JUMP_NEXT
+
+    ARRAY_UPDATE: // Do an array update
+        DO_ARRAY_UPDATE
+        JUMP_NEXT
+
+    ADD: // Do an addition
+        DO_ADD
+        JUMP_NEXT
+
+    MULT: // Do a multiplication
+        DO_MULT
+        JUMP_NEXT
+
+    DIV: // Do a division
+        DO_DIV
+        JUMP_NEXT
+
+    NAND: // Do a not-and
+        DO_NAND
+        JUMP_NEXT
+
+    HALT: // Do an halt
+        DO_STOP
+
+    ALLOC: // Do a table allocation
+        DO_ALLOC
+        JUMP_NEXT
+
+    FREE: // Free a table
+        DO_FREE
+        JUMP_NEXT
+
+    OUTPUT: // Output a char in the console
+        DO_OUTPUT
+        JUMP_NEXT
+
+    INPUT: // Input a char in the console
+        DO_INPUT
+        JUMP_NEXT
+
+    LOAD_PROG: // Load a program
+        DO_LOAD_PROG
+        JUMP_CURRENT
+
+    ORTHO: // Load a value
+        DO_ORTHO
+        JUMP_NEXT
+
+    UNKNOWN: // Stop on an unknown command
+        DO_UNKNOWN
+
+    END: // Stop at the end of the program
+        DO_STOP
+
+}
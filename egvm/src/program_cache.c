@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "program_cache.h"
+#include "machine.h"
+#include "utils.h"
+#include "allocator.h"
+
+
+// ===== Functions for the shared program cache =====
+
+// The programs are loaded once per process and kept as immutable images shared
+// by all the machine instances, an instance uses the image as its table 0 and
+// only copies it if the program modifies table 0 or loads another table
+
+// The images are identified by a hash of their content so the same program
+// reached by several paths (or rewritten with the same content) is kept once,
+// and the recently used paths remember their image (checked against the file
+// modification time and size) to skip the file reading
+
+// An image is referenced by each path pointing to it and by each instance using
+// it, it is freed when the last reference is dropped
+
+// --- File variables
+static pthread_mutex_t _cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static program_t *_programs = NULL;
+static program_path_t _paths[PROGRAM_CACHE_SIZE];
+static unsigned long long _clock = 0;
+
+// --- Internal function declarations
+static unsigned long long _hash_table(const table_t *table);
+static void _drop_program(program_t *program);
+static void _drop_path(program_path_t *path);
+
+// --- Hash the content of a table (64 bits FNV-1a on the ints)
+static unsigned long long _hash_table(const table_t *table) {
+    unsigned long long res = 0xcbf29ce484222325ULL;
+    for(unsigned int i = 0 ; i < table->size ; i++) {
+        res ^= (unsigned int) table->content[i];
+        res *= 0x100000001b3ULL;
+    }
+    return res;
+}
+
+// --- Drop a reference to a program and free it if it was the last one
+static void _drop_program(program_t *program) {
+    program->refs--;
+    if(program->refs > 0) {
+        return;
+    }
+    program_t **prev = &_programs;
+    while(*prev != program) {
+        prev = &(*prev)->next;
+    }
+    *prev = program->next;
+    delete_table(NULL, program->image);
+    free(program);
+}
+
+// --- Forget a path and drop its program
+static void _drop_path(program_path_t *path) {
+    if(path->path != NULL) {
+        free(path->path);
+        path->path = NULL;
+        _drop_program(path->program);
+        path->program = NULL;
+    }
+}
+
+// --- Get the shared image of a bytecode file (NULL if the file is missing or cannot be read)
+const table_t *acquire_program(const char *path) {
+
+    struct stat file_stat;
+    if(stat(path, &file_stat) || !S_ISREG(file_stat.st_mode)) {
+        return NULL;
+    }
+
+    // Look for the path, forget it if the file changed
+    pthread_mutex_lock(&_cache_lock);
+    for(int i = 0 ; i < PROGRAM_CACHE_SIZE ; i++) {
+        program_path_t *known = &_paths[i];
+        if(known->path == NULL || strcmp(known->path, path) != 0) {
+            continue;
+        }
+        if(known->mtime == file_stat.st_mtime && known->size == file_stat.st_size) {
+            known->program->refs++;
+            known->last_use = ++_clock;
+            pthread_mutex_unlock(&_cache_lock);
+            return known->program->image;
+        }
+        _drop_path(known);
+    }
+    pthread_mutex_unlock(&_cache_lock);
+
+    // Load and hash the program out of the lock
+    table_t *image = read_egb_file(NULL, path);
+    if(image == NULL) {
+        return NULL;
+    }
+    unsigned long long hash = _hash_table(image);
+
+    pthread_mutex_lock(&_cache_lock);
+
+    // Share an image with the same content if there is one
+    program_t *program = _programs;
+    while(program != NULL && (program->hash != hash || program->image->size != image->size ||
+        memcmp(program->image->content, image->content, image->size * sizeof(int)) != 0)) {
+        program = program->next;
+    }
+    if(program != NULL) {
+        delete_table(NULL, image);
+    } else {
+        program = (program_t *) malloc(sizeof(program_t));
+        program->hash = hash;
+        program->image = image;
+        program->refs = 0;
+        program->next = _programs;
+        _programs = program;
+    }
+
+    // Remember the path in a free slot or in the least recently used one
+    program_path_t *slot = &_paths[0];
+    for(int i = 1 ; i < PROGRAM_CACHE_SIZE && slot->path != NULL ; i++) {
+        if(_paths[i].path == NULL || _paths[i].last_use < slot->last_use) {
+            slot = &_paths[i];
+        }
+    }
+    program->refs += 2;
+    _drop_path(slot);
+    slot->path = strdup(path);
+    slot->mtime = file_stat.st_mtime;
+    slot->size = file_stat.st_size;
+    slot->program = program;
+    slot->last_use = ++_clock;
+
+    pthread_mutex_unlock(&_cache_lock);
+    return program->image;
+
+}
+
+// --- Give back an image got with acquire_program
+void release_program(const table_t *image) {
+    pthread_mutex_lock(&_cache_lock);
+    program_t *program = _programs;
+    while(program != NULL && program->image != image) {
+        program = program->next;
+    }
+    if(program != NULL) {
+        _drop_program(program);
+    }
+    pthread_mutex_unlock(&_cache_lock);
+}
+
+// --- Forget all the paths, the images still in use are freed on their release
+void clean_program_cache() {
+    pthread_mutex_lock(&_cache_lock);
+    for(int i = 0 ; i < PROGRAM_CACHE_SIZE ; i++) {
+        _drop_path(&_paths[i]);
+    }
+    pthread_mutex_unlock(&_cache_lock);
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "recorder.h"
+#include "machine.h"
+#include "utils.h"
+#include "trace.h"
+
+// OS specific imports
+#ifdef EG_UNIX
+    #include <signal.h>
+#elif EG_WINDOWS
+    // Do Windows imports
+#elif EG_MAC
+    // Do MacOS imports
+#endif
+
+
+// ===== Functions for the flight recorder =====
+
+// The last executed commands are kept in a ring buffer and only written when a
+// machine error is raised or when a signal is received (SIGUSR1 dumps and goes
+// on, SIGINT dumps and stops the machine). The dump uses the binary trace format
+// so it can be rendered with egtrace
+
+// An entry only keeps the value of the register written by its command, so the
+// recording is cheap enough for the threaded executers. The registers before
+// each command are rebuilt at the dump by undoing the commands from the current
+// registers, the newest first
+
+// --- File variables
+static machine_data_t *_recorded_data = NULL;
+
+// --- Internal function declarations
+static void _signal_handler(int signal_number);
+
+// --- Remember the received signal, the dump is done by the executer
+static void _signal_handler(int signal_number) {
+    if(_recorded_data != NULL) {
+        _recorded_data->recorder.signal = signal_number;
+    }
+}
+
+// --- Allocate the ring buffer and install the signal handlers
+void init_recorder(machine_data_t *data) {
+
+    recorder_t *recorder = &data->recorder;
+    if(recorder->size == 0) {
+        recorder->size = RECORDER_DEFAULT_SIZE;
+    }
+    recorder->entries = (recorder_entry_t *) malloc(recorder->size * sizeof(recorder_entry_t));
+    recorder->pos = 0;
+    recorder->full = 0;
+    recorder->signal = 0;
+    recorder->dump_file = change_extension(data->egb_file_name, "flight");
+
+#ifdef EG_UNIX
+    _recorded_data = data;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _signal_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+#endif
+
+}
+
+// --- Restore the signal handlers and free the ring buffer
+void clean_recorder(machine_data_t *data) {
+
+#ifdef EG_UNIX
+    signal(SIGUSR1, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    _recorded_data = NULL;
+#endif
+
+    free(data->recorder.entries);
+    free(data->recorder.dump_file);
+    data->recorder.entries = NULL;
+    data->recorder.dump_file = NULL;
+
+}
+
+// --- Write the recorded commands from the oldest to the newest in the dump file
+void dump_recorder(machine_data_t *data) {
+
+    recorder_t *recorder = &data->recorder;
+    trace_t trace;
+    if(open_trace(&trace, recorder->dump_file)) {
+        fprintf(stderr, "\"%s\" : Cannot write the flight recorder dump\n", recorder->dump_file);
+        return;
+    }
+
+    // Rebuild the registers before each command from the newest to the oldest
+    unsigned int recorded = recorder->full ? recorder->size : recorder->pos;
+    int *states = (int *) malloc((recorded > 0 ? recorded : 1) * sizeof(int) * REGISTER_NUMBER);
+    int registers[REGISTER_NUMBER];
+    memcpy(registers, data->registers, sizeof(registers));
+    unsigned int index = recorder->pos;
+    for(unsigned int i = recorded ; i > 0 ; i--) {
+        index = index == 0 ? recorder->size - 1 : index - 1;
+        recorder_entry_t *entry = &recorder->entries[index];
+        registers[WRITTEN_REGISTER(entry->command)] = entry->previous;
+        memcpy(states + (i - 1) * REGISTER_NUMBER, registers, sizeof(registers));
+    }
+
+    // Write from the oldest entry, which is the next one to overwrite once the ring is full
+    for(unsigned int i = 0 ; i < recorded ; i++) {
+        recorder_entry_t *entry = &recorder->entries[index];
+        write_trace(&trace, entry->exec_p, entry->command, states + i * REGISTER_NUMBER);
+        if(++index == recorder->size) {
+            index = 0;
+        }
+    }
+    free(states);
+
+    close_trace(&trace);
+    fprintf(stderr, "Flight recorder : last %u commands written in \"%s\"\n", recorded, recorder->dump_file);
+
+}
+
+// --- Dump the recorder if a signal was received (stop the machine on SIGINT)
+void check_recorder_signal(machine_data_t *data) {
+
+    int signal_number = data->recorder.signal;
+    data->recorder.signal = 0;
+    dump_recorder(data);
+
+#ifdef EG_UNIX
+    if(signal_number == SIGINT) {
+        data->flags &= ~RUNNING_FLAG;
+    }
+#endif
+
+}
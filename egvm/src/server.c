@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "machine.h"
+#include "utils.h"
+#include "snapshot.h"
+#include "program_cache.h"
+
+
+// ===== Functions for the server mode =====
+
+// The server listens on a Unix socket and pushes the accepted connections in a
+// bounded queue, a pool of worker threads pops them and runs one job each on
+// the machine instance owned by the worker
+
+// A job is the path of a bytecode file ended by a new line, followed by the
+// program input until the client shuts its side down. The program output is
+// sent back on the connection, followed by an error line if the machine failed,
+// then the connection is closed
+
+// The programs come from the shared program cache, so a job neither reads the
+// bytecode file again nor copies the program unless it modifies it
+
+// --- File variables
+static volatile sig_atomic_t _stopping = 0;
+
+// --- Internal function declarations
+static void _stop_handler(int signal_number);
+static void _push_job(server_t *server, int fd);
+static int _pop_job(server_t *server);
+static int _read_request(int fd, char *path);
+static void _run_job(server_t *server, machine_data_t *data, int fd);
+static void *_worker(void *arg);
+
+// --- Request the server to stop
+static void _stop_handler(int signal_number) {
+    (void) signal_number;
+    _stopping = 1;
+}
+
+// --- Push a connection in the job queue, wait if it is full
+static void _push_job(server_t *server, int fd) {
+    pthread_mutex_lock(&server->queue_lock);
+    while(server->queue_size == SERVER_QUEUE_SIZE) {
+        pthread_cond_wait(&server->queue_emptied, &server->queue_lock);
+    }
+    server->queue[(server->queue_start + server->queue_size) % SERVER_QUEUE_SIZE] = fd;
+    server->queue_size++;
+    pthread_cond_signal(&server->queue_filled);
+    pthread_mutex_unlock(&server->queue_lock);
+}
+
+// --- Pop a connection from the job queue, wait if it is empty
+static int _pop_job(server_t *server) {
+    pthread_mutex_lock(&server->queue_lock);
+    while(server->queue_size == 0) {
+        pthread_cond_wait(&server->queue_filled, &server->queue_lock);
+    }
+    int fd = server->queue[server->queue_start];
+    server->queue_start = (server->queue_start + 1) % SERVER_QUEUE_SIZE;
+    server->queue_size--;
+    pthread_cond_signal(&server->queue_emptied);
+    pthread_mutex_unlock(&server->queue_lock);
+    return fd;
+}
+
+// --- Read the bytecode path of a job, up to the new line (return 1 on failure)
+static int _read_request(int fd, char *path) {
+    unsigned int size = 0;
+    while(size < SERVER_PATH_MAX - 1) {
+        if(read(fd, path + size, 1) != 1) {
+            return 1;
+        }
+        if(path[size] == '\n') {
+            path[size] = '\0';
+            return size == 0;
+        }
+        size++;
+    }
+    return 1;
+}
+
+// --- Run a job on the worker machine and close its connection
+static void _run_job(server_t *server, machine_data_t *data, int fd) {
+
+    char path[SERVER_PATH_MAX];
+    if(_read_request(fd, path)) {
+        dprintf(fd, "Bad job request\n");
+        close(fd);
+        return;
+    }
+
+    const table_t *image = acquire_program(path);
+    if(image == NULL) {
+        dprintf(fd, "\"%s\" : File not found\n", path);
+        close(fd);
+        return;
+    }
+
+    // Reset the machine instance for the job
+    data->error->error_code = 0;
+    data->error->error_offset = 0;
+    data->flags = server->flags | RUNNING_FLAG;
+    data->egb_file_name = path;
+    data->program_image = image;
+    data->input_fd = fd;
+    data->output_fd = fd;
+
+    run_machine(data);
+    release_program(image);
+
+    // Report the machine error to the client
+    if(data->error->error_code) {
+        dprintf(fd, "Universal machine error (offset %u) : %s\n", data->error->error_offset, data->error->error_message);
+    }
+    close(fd);
+
+}
+
+// --- Main function of a worker, run jobs until a negative connection is popped
+static void *_worker(void *arg) {
+
+    server_t *server = (server_t *) arg;
+
+    // Create the machine instance of the worker
+    machine_error_t error;
+    machine_data_t *data = (machine_data_t *) calloc(1, sizeof(machine_data_t));
+    data->error = &error;
+    data->snapshot_at = SNAPSHOT_NEVER;
+    data->max_steps = server->max_steps;
+    data->max_tables = server->max_tables;
+    data->max_memory = server->max_memory;
+
+    int fd;
+    while((fd = _pop_job(server)) >= 0) {
+        _run_job(server, data, fd);
+    }
+
+    free(data);
+    return NULL;
+
+}
+
+// --- Run the server until SIGINT or SIGTERM (return 1 on failure)
+int run_server(machine_data_t *settings) {
+
+    server_t *server = (server_t *) calloc(1, sizeof(server_t));
+    pthread_mutex_init(&server->queue_lock, NULL);
+    pthread_cond_init(&server->queue_filled, NULL);
+    pthread_cond_init(&server->queue_emptied, NULL);
+
+    // Keep the execution settings which are safe to share between the instances,
+    // the jobs run in the checked mode so a bad program only fails its own job
+    // unless the unchecked JIT mode is wanted
+    server->flags = settings->flags & (SLAB_FLAG | STATS_FLAG | JIT_FLAG);
+    if(!(server->flags & JIT_FLAG)) {
+        server->flags |= CHECKED_FLAG;
+    }
+    server->max_steps = settings->max_steps;
+    server->max_tables = settings->max_tables;
+    server->max_memory = settings->max_memory;
+
+    // Listen on the socket
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, settings->server_socket, sizeof(address.sun_path) - 1);
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(address.sun_path);
+    if(server->listen_fd < 0 || bind(server->listen_fd, (struct sockaddr *) &address, sizeof(address)) || listen(server->listen_fd, SOMAXCONN)) {
+        fprintf(stderr, "\"%s\" : Cannot listen on the socket\n", settings->server_socket);
+        free(server);
+        return 1;
+    }
+
+    // Ignore the closed connections and stop on SIGINT or SIGTERM
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    action.sa_handler = _stop_handler;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Start the workers
+    pthread_t workers[SERVER_WORKERS_MAX];
+    unsigned int worker_number = settings->server_workers;
+    for(unsigned int i = 0 ; i < worker_number ; i++) {
+        pthread_create(&workers[i], NULL, _worker, server);
+    }
+    if(settings->flags & VERBOSE_FLAG) {
+        fprintf(stderr, "Listening on \"%s\" with %u workers\n", settings->server_socket, worker_number);
+    }
+
+    // Accept the connections until a stop is requested
+    while(!_stopping) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if(fd >= 0) {
+            _push_job(server, fd);
+        } else if(errno != EINTR) {
+            break;
+        }
+    }
+
+    // Stop the workers once the queued jobs are done
+    for(unsigned int i = 0 ; i < worker_number ; i++) {
+        _push_job(server, -1);
+    }
+    for(unsigned int i = 0 ; i < worker_number ; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    // Clean up the socket and the cache
+    close(server->listen_fd);
+    unlink(address.sun_path);
+    clean_program_cache();
+    pthread_mutex_destroy(&server->queue_lock);
+    pthread_cond_destroy(&server->queue_filled);
+    pthread_cond_destroy(&server->queue_emptied);
+    free(server);
+
+    return 0;
+
+}
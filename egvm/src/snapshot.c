@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "machine.h"
+#include "allocator.h"
+#include "io.h"
+
+// OS specific imports
+#ifdef EG_UNIX
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#elif EG_WINDOWS
+    // Do Windows imports
+#elif EG_MAC
+    // Do MacOS imports
+#endif
+
+
+// ===== Functions to save and restore the machine state =====
+
+// A snapshot is taken between two commands when the instruction count reaches
+// the wanted one or when SIGUSR2 is received (the handler only lowers the wanted
+// count), the executers test it on each program loading so it costs one compare
+// per jump. The file is written in the native endianess :
+//     magic | version | exec_p | registers | table array size | shared index
+//     | steps (8 bytes) | free list size | free list indexes | unread input size
+//     | unread input (padded to 4 bytes) | tables
+// Each table is its size followed by its content, or a free or shared marker
+
+// --- File variables
+static machine_data_t *_snapshot_data = NULL;
+
+// --- Internal function declarations
+static void _signal_handler(int signal_number);
+static void _write_ints(FILE *file, const void *ints, unsigned int size);
+
+// --- Request a snapshot at the next check
+static void _signal_handler(int signal_number) {
+    (void) signal_number;
+    if(_snapshot_data != NULL) {
+        _snapshot_data->snapshot_at = 0;
+    }
+}
+
+// --- Write ints in the snapshot file
+static void _write_ints(FILE *file, const void *ints, unsigned int size) {
+    fwrite(ints, sizeof(int), size, file);
+}
+
+// --- Install the snapshot signal handler
+void init_snapshot(machine_data_t *data) {
+
+#ifdef EG_UNIX
+    _snapshot_data = data;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _signal_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR2, &action, NULL);
+#endif
+
+}
+
+// --- Restore the default signal handler
+void clean_snapshot(machine_data_t *data) {
+
+    (void) data;
+#ifdef EG_UNIX
+    signal(SIGUSR2, SIG_DFL);
+    _snapshot_data = NULL;
+#endif
+
+}
+
+// --- Write the machine state in the snapshot file (the state must be saved in the machine data)
+void take_snapshot(machine_data_t *data) {
+
+    // The next snapshot is only taken on a signal
+    data->snapshot_at = SNAPSHOT_NEVER;
+
+    // Write in a temporary file renamed at the end so a snapshot is never partial
+    unsigned int name_size = strlen(data->snapshot_file);
+    char *tmp_name = (char *) malloc(name_size + 5);
+    memcpy(tmp_name, data->snapshot_file, name_size);
+    strcpy(tmp_name + name_size, ".tmp");
+    FILE *file = fopen(tmp_name, "wb");
+    if(file == NULL) {
+        fprintf(stderr, "\"%s\" : Cannot write the snapshot\n", tmp_name);
+        free(tmp_name);
+        return;
+    }
+
+    // Write the output produced before the snapshot
+    flush_output(data);
+
+    // Write the header and the machine state (a shared image is saved as the program)
+    unsigned int shared_index = data->shared_index != SHARED_IMAGE ? data->shared_index : 0;
+    unsigned int header[5] = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, data->exec_p, data->table_array_size, shared_index};
+    _write_ints(file, header, 3);
+    _write_ints(file, data->registers, REGISTER_NUMBER);
+    _write_ints(file, header + 3, 2);
+    _write_ints(file, &data->stats.steps, 2);
+
+    // Write the free list indexes in the list order and mark the free slots
+    char *freed = (char *) calloc(data->table_array_size + 1, 1);
+    unsigned int free_size = 0;
+    for(table_t **freel = data->free_start ; freel != NULL ; freel = FREE_NEXT(freel)) {
+        free_size++;
+    }
+    _write_ints(file, &free_size, 1);
+    for(table_t **freel = data->free_start ; freel != NULL ; freel = FREE_NEXT(freel)) {
+        unsigned int index = (unsigned int) (freel - data->table_array);
+        freed[index] = 1;
+        _write_ints(file, &index, 1);
+    }
+
+    // Write the unread input
+    unsigned int input_size = data->input_size - data->input_pos;
+    char padding[4] = {0};
+    _write_ints(file, &input_size, 1);
+    fwrite(data->input_buffer + data->input_pos, 1, input_size, file);
+    fwrite(padding, 1, (4 - input_size % 4) % 4, file);
+
+    // Write the tables, the free slots of the array hold the free list
+    for(unsigned int i = 0 ; i < data->table_array_size ; i++) {
+        table_t *table = data->table_array[i];
+        unsigned int marker;
+        if(i == 0 && shared_index != 0) {
+            marker = SNAPSHOT_SHARED_TABLE;
+            _write_ints(file, &marker, 1);
+        } else if(freed[i] || table == NULL) {
+            marker = SNAPSHOT_FREE_TABLE;
+            _write_ints(file, &marker, 1);
+        } else {
+            _write_ints(file, table, table->size + 1);
+        }
+    }
+
+    free(freed);
+
+    // Publish the snapshot
+    int failed = ferror(file);
+    failed |= fclose(file);
+    if(failed || rename(tmp_name, data->snapshot_file)) {
+        fprintf(stderr, "\"%s\" : Cannot write the snapshot\n", data->snapshot_file);
+    } else if(data->flags & VERBOSE_FLAG) {
+        fprintf(stderr, "Snapshot after %llu instructions written in \"%s\"\n", data->stats.steps, data->snapshot_file);
+    }
+    free(tmp_name);
+
+}
+
+// --- Restore the machine state from a snapshot file (return 1 on a bad snapshot)
+int restore_snapshot(machine_data_t *data, const char *file_name) {
+
+#ifdef EG_UNIX
+    // Map the snapshot in memory
+    int fd = open(file_name, O_RDONLY);
+    if(fd < 0) {
+        return 1;
+    }
+    struct stat file_stat;
+    fstat(fd, &file_stat);
+    unsigned int file_size = file_stat.st_size / 4;
+    unsigned int *file_p = NULL;
+    if(file_size > 0) {
+        file_p = (unsigned int *) mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(file_p == NULL || file_p == MAP_FAILED) {
+        return 1;
+    }
+
+    // Check the header and the fixed size state
+    unsigned int *p = file_p;
+    unsigned int *end = file_p + file_size;
+    int res = 1;
+    if(file_size < 18 || p[0] != SNAPSHOT_MAGIC || p[1] != SNAPSHOT_VERSION) {
+        goto unmap;
+    }
+    data->exec_p = p[2];
+    memcpy(data->registers, p + 3, sizeof(data->registers));
+    p += 3 + REGISTER_NUMBER;
+    unsigned int table_array_size = p[0];
+    unsigned int shared_index = p[1];
+    memcpy(&data->stats.steps, p + 2, sizeof(data->stats.steps));
+    p += 4;
+
+    // Get the free list and the unread input
+    unsigned int free_size = *p++;
+    if(free_size > (unsigned int) (end - p)) {
+        goto unmap;
+    }
+    unsigned int *free_indexes = p;
+    p += free_size;
+    if(p >= end || *p > INPUT_BUFFER_SIZE || (*p + 3) / 4 >= (unsigned int) (end - p)) {
+        goto unmap;
+    }
+    data->input_size = *p++;
+    data->input_pos = 0;
+    memcpy(data->input_buffer, p, data->input_size);
+    p += (data->input_size + 3) / 4;
+
+    // Copy the tables in the allocator
+    data->table_array_cap = table_array_size > 0 ? table_array_size : 1;
+    data->table_array = (table_t **) realloc(data->table_array, data->table_array_cap * sizeof(table_t *));
+    memset(data->table_array, 0, data->table_array_cap * sizeof(table_t *));
+    data->table_array_size = table_array_size;
+    for(unsigned int i = 0 ; i < table_array_size ; i++) {
+        if(p >= end) {
+            goto clean;
+        }
+        unsigned int size = *p++;
+        if(size == SNAPSHOT_FREE_TABLE || size == SNAPSHOT_SHARED_TABLE) {
+            continue;
+        }
+        if(size > (unsigned int) (end - p)) {
+            goto clean;
+        }
+        data->table_array[i] = new_table(data, size);
+        memcpy(data->table_array[i]->content, p, size * sizeof(int));
+        p += size;
+        data->stats.live_memory += (unsigned long long) size * sizeof(int);
+        if(i > 0) {
+            data->stats.live_tables++;
+        }
+    }
+    data->stats.peak_tables = data->stats.live_tables;
+
+    // Share the program table again
+    if(table_array_size == 0 || shared_index >= table_array_size || (shared_index != 0 && data->table_array[shared_index] == NULL)) {
+        goto clean;
+    }
+    if(shared_index != 0) {
+        data->table_array[0] = data->table_array[shared_index];
+        data->shared_index = shared_index;
+    }
+    if(data->table_array[0] == NULL || data->exec_p > data->table_array[0]->size) {
+        goto clean;
+    }
+
+    // Rebuild the free list in the saved order
+    for(unsigned int i = 0 ; i < free_size ; i++) {
+        if(free_indexes[i] == 0 || free_indexes[i] >= table_array_size || data->table_array[free_indexes[i]] != NULL) {
+            goto clean;
+        }
+    }
+    for(unsigned int i = free_size ; i > 0 ; i--) {
+        unsigned int index = free_indexes[i - 1];
+        data->table_array[index] = FREE_LINK(data->free_start);
+        data->free_start = &data->table_array[index];
+    }
+    res = 0;
+    goto unmap;
+
+clean:
+    // Give back the restored tables and leave an empty machine
+    for(unsigned int i = 1 ; i < table_array_size ; i++) {
+        if(data->table_array[i] != NULL) {
+            delete_table(data, data->table_array[i]);
+        }
+    }
+    if(data->shared_index == 0 && data->table_array[0] != NULL) {
+        delete_table(data, data->table_array[0]);
+    }
+    data->table_array[0] = NULL;
+    data->table_array_size = 1;
+    data->shared_index = 0;
+
+unmap:
+    munmap(file_p, file_stat.st_size);
+    return res;
+#else
+    (void) data;
+    (void) file_name;
+    return 1;
+#endif
+
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "machine.h"
+#include "utils.h"
+
+
+// ===== Functions to write and decode the binary execution trace =====
+
+// A trace file starts with a header (magic and version) followed by one record
+// per executed command, in the native endianess :
+//     exec_p (4 bytes) | command (4 bytes) | register mask (1 byte) | values
+// The registers are those before the command execution, only the registers
+// changed since the previous record are stored (one bit of the mask and one
+// value each), so the decoder rebuilds them from zeroed registers
+
+// --- Internal function declarations
+static void _flush_trace(trace_t *trace);
+
+// --- Write the buffered records in the trace file
+static void _flush_trace(trace_t *trace) {
+    fwrite(trace->buffer, 1, trace->size, trace->file);
+    trace->size = 0;
+}
+
+// --- Open a trace file and write its header (return 1 on failure)
+int open_trace(trace_t *trace, const char *file_name) {
+
+    trace->file = fopen(file_name, "wb");
+    if(trace->file == NULL) {
+        return 1;
+    }
+
+    trace->buffer = (unsigned char *) malloc(TRACE_BUFFER_SIZE);
+    trace->size = 0;
+    memset(trace->registers, 0, sizeof(trace->registers));
+
+    // Write the header
+    unsigned int header[2] = {TRACE_MAGIC, TRACE_VERSION};
+    memcpy(trace->buffer, header, sizeof(header));
+    trace->size = sizeof(header);
+
+    return 0;
+
+}
+
+// --- Append the record of a command to the trace
+void write_trace(trace_t *trace, unsigned int exec_p, unsigned int command, const int *registers) {
+
+    // Flush the buffer if the record may not fit
+    if(trace->size + TRACE_RECORD_MAX_SIZE > TRACE_BUFFER_SIZE) {
+        _flush_trace(trace);
+    }
+
+    unsigned char *record = trace->buffer + trace->size;
+    memcpy(record, &exec_p, 4);
+    memcpy(record + 4, &command, 4);
+
+    // Write the changed registers after the mask
+    unsigned char mask = 0;
+    unsigned int record_size = 9;
+    for(int i = 0 ; i < REGISTER_NUMBER ; i++) {
+        if(registers[i] != trace->registers[i]) {
+            mask |= 1 << i;
+            trace->registers[i] = registers[i];
+            memcpy(record + record_size, registers + i, 4);
+            record_size += 4;
+        }
+    }
+    record[8] = mask;
+
+    trace->size += record_size;
+
+}
+
+// --- Flush and close a trace file
+void close_trace(trace_t *trace) {
+    _flush_trace(trace);
+    fclose(trace->file);
+    free(trace->buffer);
+}
+
+// --- Render a binary trace in the text format (return 1 on a bad trace)
+int decode_trace(FILE *input, FILE *output) {
+
+    // Check the header
+    unsigned int header[2];
+    if(fread(header, sizeof(header), 1, input) != 1 || header[0] != TRACE_MAGIC || header[1] != TRACE_VERSION) {
+        return 1;
+    }
+
+    // Rebuild the registers record by record
+    int registers[REGISTER_NUMBER] = {0};
+    unsigned char record[9];
+    while(fread(record, 9, 1, input) == 1) {
+        unsigned int command;
+        memcpy(&command, record + 4, 4);
+        for(int i = 0 ; i < REGISTER_NUMBER ; i++) {
+            if(record[8] & (1 << i)) {
+                if(fread(registers + i, 4, 1, input) != 1) {
+                    return 1;
+                }
+            }
+        }
+        write_step(registers, command, output);
+    }
+
+    return 0;
+
+}
@@ -2,50 +2,114 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #include "utils.h"
 #include "machine.h"
+#include "allocator.h"
 
 // OS specific imports
 #ifdef EG_UNIX
-    #include <termios.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
 #elif EG_WINDOWS
     // Do Windows imports
 #elif EG_MAC
     // Do MacOS imports
 #endif
 
+// SIMD imports for the buffer endianess reversing
+#if defined(__AVX2__) || defined(__SSSE3__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
 
 // ===== Untils functions =====
 
 // --- File variables
 static const char *_command_names[14] = {"MOVE", "ARIN", "ARUP", "ADDI", "MULT", "DIVI", "NAND", "HALT", "ALOC", "FREE", "OUTP", "INPT", "LOAD", "ORTH"};
 
-// --- Read the egb file and return a new table with its content
-table_t *read_egb_file(const char *file_name) {
+// --- Read the egb file and return a new table with its content (NULL if the
+// file cannot be read)
+#ifdef EG_UNIX
+table_t *read_egb_file(machine_data_t *data, const char *file_name) {
+
+    // Open the file and get its size in int
+    int fd = open(file_name, O_RDONLY);
+    if(fd < 0) {
+        return NULL;
+    }
+    struct stat file_stat;
+    if(fstat(fd, &file_stat)) {
+        close(fd);
+        return NULL;
+    }
+    unsigned int file_size = file_stat.st_size / 4;
+
+    // Map the file in memory
+    unsigned int *file_p = NULL;
+    if(file_size > 0) {
+        file_p = (unsigned int *) mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(file_p == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd);
+
+    // Skip the endianess swap if the file is tagged native endian
+    unsigned int start = 0;
+    char native = 0;
+    if(file_size > 0 && file_p[0] == EGB_NATIVE_MAGIC) {
+        start = 1;
+        native = 1;
+    }
+
+    // Allocate the memory for the result
+    table_t *res = new_table(data, file_size - start);
+    unsigned int *buffer_p = (unsigned int *) res->content;
+
+    // Copy the file content in a single pass
+    if(native) {
+        memcpy(buffer_p, file_p + start, (file_size - start) * sizeof(int));
+    } else {
+        // TODO : Test the endianess of the computer
+        reverse_buffer(buffer_p, file_p, file_size);
+    }
+
+    // Unmap the file
+    if(file_p != NULL) {
+        munmap(file_p, file_stat.st_size);
+    }
+
+    // Return the result
+    return res;
+
+}
+#else
+table_t *read_egb_file(machine_data_t *data, const char *file_name) {
 
     // Open the file and get its size in int
     FILE *file = fopen(file_name, "r");
+    if(file == NULL) {
+        return NULL;
+    }
     fseek(file, 0L, SEEK_END);
     long file_size = ftell(file) / 4;
     rewind(file);
 
     // Allocate the memory for the result
-    table_t *res = (table_t *) malloc((file_size + 1) * sizeof(int));
-    res->size = file_size;
+    table_t *res = new_table(data, file_size);
     int *buffer_p = res->content;
 
-    // Read the file and store it into the buffer
-    for(int i = 0 ; i < file_size ; i++) {
-        if(fread(buffer_p, 4, 1, file) == 1) {
-            // TODO : Test the endianess of the computer
-            *buffer_p = REVERSER(*buffer_p);
-
-            buffer_p++;
-        }
+    // Read the file and reverse the buffer endianess
+    if(fread(buffer_p, 4, file_size, file) == (size_t) file_size) {
+        // TODO : Test the endianess of the computer
+        reverse_buffer((unsigned int *) buffer_p, (unsigned int *) buffer_p, file_size);
     }
-    
-    printf("%d\n", res->content[0]);
 
     // Close the file
     fclose(file);
@@ -54,9 +118,10 @@ table_t *read_egb_file(const char *file_name) {
     return res;
 
 }
+#endif
 
-// --- Write the execution trace step in a file
-void write_step(machine_data_t *data, unsigned int command, FILE *file) {
+// --- Write an execution trace step in the text format
+void write_step(const int *registers, unsigned int command, FILE *file) {
 
     // Write the current command and its args
     int a, b, c, s_a, v, com;
@@ -78,12 +143,19 @@ void write_step(machine_data_t *data, unsigned int command, FILE *file) {
     // Write the current registers state
     fprintf(file, "\t\t[");
     for(int i = 0 ; i < REGISTER_NUMBER ; i++) {
-        fprintf(file, "%d ", data->registers[i]);
+        fprintf(file, "%d ", registers[i]);
     }
     fprintf(file, "]\n");
 
 }
 
+// --- Get the current monotonic time in seconds
+double get_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
 // --- Change the file extension
 char *change_extension(char *file_name, char *new_extension) {
 
@@ -103,8 +175,9 @@ char *change_extension(char *file_name, char *new_extension) {
     unsigned int extension_size = strlen(new_extension);
 
     // Prepare the memory to store the result and copy the memory
-    char *res = (char *) malloc((ld_pos + extension_size) * sizeof(char));
+    char *res = (char *) malloc((ld_pos + extension_size + 2) * sizeof(char));
     memcpy(res, file_name, ld_pos * sizeof(char));
+    res[ld_pos] = '\0';
     strcat(res, ".");
     strcat(res, new_extension);
 
@@ -118,36 +191,53 @@ int reverse(int to_reverse) {
     return ((to_reverse>>24)&0xFF) | ((to_reverse<<8)&0xFF0000) | ((to_reverse>>8)&0xFF00) | ((to_reverse<<24)&0xFF000000);
 }
 
-// --- The identity function
-int identity(int ident) {
-    return ident;
-}
-
-// --- UNIX | Read a char from the console
-char unix_read_char() {
+// --- Reverse the endianess of a whole buffer (the destination can be the source)
+void reverse_buffer(unsigned int *dst, const unsigned int *src, unsigned int size) {
 
-    // Save the old terminal config
-    static struct termios oldt, newt;
-    tcgetattr(STDIN_FILENO, &oldt);
-
-    // Set the buffering to off
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-
-    // Read the char
-    char res = getchar();
+    unsigned int i = 0;
 
-    // Reset the terminal
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+#if defined(__AVX2__)
+    // AVX2 : Shuffle the bytes of 8 ints at a time
+    const __m256i mask = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                         12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for(; i + 8 <= size ; i += 8) {
+        __m256i words = _mm256_loadu_si256((const __m256i *) (src + i));
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_shuffle_epi8(words, mask));
+    }
+#elif defined(__SSSE3__)
+    // SSSE3 : Shuffle the bytes of 4 ints at a time
+    const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for(; i + 4 <= size ; i += 4) {
+        __m128i words = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_shuffle_epi8(words, mask));
+    }
+#elif defined(__SSE2__)
+    // SSE2 : Swap the bytes of each half then swap the halves of 4 ints at a time
+    for(; i + 4 <= size ; i += 4) {
+        __m128i words = _mm_loadu_si128((const __m128i *) (src + i));
+        words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+        words = _mm_shufflelo_epi16(words, 0xB1);
+        words = _mm_shufflehi_epi16(words, 0xB1);
+        _mm_storeu_si128((__m128i *) (dst + i), words);
+    }
+#endif
 
-    return res;
+    // Portable fallback for the remaining ints
+    for(; i < size ; i++) {
+        dst[i] = (unsigned int) reverse((int) src[i]);
+    }
 
 }
 
-// --- Windows | Read a char from the console
+// --- The identity function
+int identity(int ident) {
+    return ident;
+}
 
-// --- MacOS | Read a char from the console
+// --- Get the name of a command number
+const char *get_command_name(int command) {
+    return command >= 0 && command <= 13 ? _command_names[command] : "????";
+}
 
 // --- Get the command number
 int get_command(unsigned int command) {
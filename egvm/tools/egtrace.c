@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+
+// ===== Decoder of the egvm binary execution traces =====
+
+// --- Main function of the decoder
+int main(int argc, char *argv[]) {
+
+    // Check the arguments
+    if(argc < 2 || argc > 3) {
+        printf("Usage : egtrace <FILE.trace> [OUTPUT.exec]\n");
+        printf("Render a binary execution trace of egvm (-d -l) in the text format\n");
+        return 1;
+    }
+
+    // Open the files
+    FILE *input = fopen(argv[1], "rb");
+    if(input == NULL) {
+        printf("\"%s\" : Cannot open the trace file\n", argv[1]);
+        return 1;
+    }
+    FILE *output = stdout;
+    if(argc == 3) {
+        output = fopen(argv[2], "w");
+        if(output == NULL) {
+            printf("\"%s\" : Cannot open the output file\n", argv[2]);
+            fclose(input);
+            return 1;
+        }
+    }
+
+    // Decode the trace
+    int res = decode_trace(input, output);
+    if(res != 0) {
+        fprintf(stderr, "\"%s\" : Bad or truncated trace file\n", argv[1]);
+    }
+
+    fclose(input);
+    if(output != stdout) {
+        fclose(output);
+    }
+
+    return res;
+
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+
+# Run egvm on all the programs of the test directory and write the results
+# in a CSV file to compare the interpreter changes across commits
+#
+# Usage : bench.sh <EGVM> [OUTPUT.csv] [EGVM OPTIONS]
+
+EGVM=${1:-bin/egvm}
+OUTPUT=${2:-bench_output.txt}
+[ $# -gt 2 ] && shift 2 || shift $#
+
+TEST_DIR=$(dirname "$0")
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+STATS_FILE=$(mktemp)
+
+# Get a statistic value from the egvm report
+get_stat() {
+    sed -n "s/^ *$1 : //p" "$STATS_FILE"
+}
+
+echo "commit,program,wall_time,instructions,mips,load_time,allocations,frees,peak_tables,peak_rss_kib" > "$OUTPUT"
+
+for program in "$TEST_DIR"/*.umz "$TEST_DIR"/*.egb ; do
+    [ -f "$program" ] || continue
+
+    # Run the program and measure the wall time
+    start=$(date +%s.%N)
+    "$EGVM" -s "$@" "$program" < /dev/null > /dev/null 2> "$STATS_FILE"
+    status=$?
+    end=$(date +%s.%N)
+    wall=$(echo "$end - $start" | awk '{ printf "%.3f", $1 - $3 }')
+
+    if [ $status -ne 0 ] ; then
+        echo "$(basename "$program") : failed with status $status" >&2
+        continue
+    fi
+
+    # Display and store the results
+    echo "$(basename "$program") : ${wall} s, $(get_stat instructions) instructions, $(get_stat mips) MIPS, $(get_stat peak_rss_kib) KiB"
+    echo "$COMMIT,$(basename "$program"),$wall,$(get_stat instructions),$(get_stat mips),$(get_stat load_time),$(get_stat allocations),$(get_stat frees),$(get_stat peak_tables),$(get_stat peak_rss_kib)" >> "$OUTPUT"
+done
+
+rm -f "$STATS_FILE"
+echo "Results written in $OUTPUT"
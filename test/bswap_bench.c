@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+
+#define BENCH_SIZE (16 * 1024 * 1024)
+#define BENCH_ROUNDS 10
+
+
+// ===== Micro-benchmark of the endianess reversing =====
+
+// --- Get the current monotonic time in seconds
+static double _now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+// --- Compare the scalar reverse() with the bulk reverse_buffer()
+int main() {
+
+    // Prepare the buffers with pseudo random words
+    unsigned int *src = (unsigned int *) malloc(BENCH_SIZE * sizeof(int));
+    unsigned int *scalar_dst = (unsigned int *) malloc(BENCH_SIZE * sizeof(int));
+    unsigned int *bulk_dst = (unsigned int *) malloc(BENCH_SIZE * sizeof(int));
+    srand(42);
+    for(unsigned int i = 0 ; i < BENCH_SIZE ; i++) {
+        src[i] = ((unsigned int) rand() << 16) ^ (unsigned int) rand();
+    }
+
+    // Time the scalar version
+    double start = _now();
+    for(int r = 0 ; r < BENCH_ROUNDS ; r++) {
+        for(unsigned int i = 0 ; i < BENCH_SIZE ; i++) {
+            scalar_dst[i] = (unsigned int) reverse((int) src[i]);
+        }
+    }
+    double scalar_time = (_now() - start) / BENCH_ROUNDS;
+
+    // Time the bulk version
+    start = _now();
+    for(int r = 0 ; r < BENCH_ROUNDS ; r++) {
+        reverse_buffer(bulk_dst, src, BENCH_SIZE);
+    }
+    double bulk_time = (_now() - start) / BENCH_ROUNDS;
+
+    // Verify the results and display the report
+    double mega_bytes = (double) BENCH_SIZE * sizeof(int) / (1024 * 1024);
+    int same = memcmp(scalar_dst, bulk_dst, BENCH_SIZE * sizeof(int)) == 0;
+    printf("reverse()        : %8.3f ms (%8.1f MB/s)\n", scalar_time * 1000, mega_bytes / scalar_time);
+    printf("reverse_buffer() : %8.3f ms (%8.1f MB/s)\n", bulk_time * 1000, mega_bytes / bulk_time);
+    printf("Speedup : %.2fx, results %s\n", scalar_time / bulk_time, same ? "identical" : "DIFFERENT");
+
+    free(src);
+    free(scalar_dst);
+    free(bulk_dst);
+
+    return !same;
+
+}
@@ -0,0 +1,101 @@
+#!/bin/sh
+
+# Run small bytecode programs freeing tables twice or using freed tables and
+# check that the safe modes stop them with the right machine error, then run
+# a self-modifying program and check that every engine gives the same output
+#
+# Usage : checked_test.sh <EGVM>
+
+EGVM=${1:-bin/egvm}
+WORK_DIR=$(mktemp -d)
+FAILURES=0
+
+# Write a command word in big endian
+word() {
+    printf "$(printf '\\%03o\\%03o\\%03o\\%03o' $(( ($1 >> 24) & 255 )) $(( ($1 >> 16) & 255 )) $(( ($1 >> 8) & 255 )) $(( $1 & 255 )))"
+}
+
+# Write a standard command (opcode, A, B, C)
+command() {
+    word $(( ($1 << 28) | ($2 << 6) | ($3 << 3) | $4 ))
+}
+
+# Write an ortho command (register, value)
+ortho() {
+    word $(( (13 << 28) | ($1 << 25) | $2 ))
+}
+
+# Allocate the tables 1, 2 and 3 of 4 plates in r1, r2 and r3
+alloc_three() {
+    ortho 7 4
+    command 8 0 1 7
+    command 8 0 2 7
+    command 8 0 3 7
+}
+
+# Run a program in a mode and check its exit status
+check() {
+    name=$1
+    expected=$2
+    shift 2
+    "$EGVM" "$@" "$WORK_DIR/$name.egb" < /dev/null > /dev/null 2>&1
+    status=$?
+    if [ $status -ne "$expected" ] ; then
+        echo "$name ($*) : expected status $expected, got $status" >&2
+        FAILURES=$((FAILURES + 1))
+    else
+        echo "$name ($*) : ok"
+    fi
+}
+
+# Run a program in a mode and check its output
+check_output() {
+    name=$1
+    expected=$2
+    shift 2
+    output=$("$EGVM" "$@" "$WORK_DIR/$name.egb" < /dev/null 2> /dev/null)
+    if [ "$output" != "$expected" ] ; then
+        echo "$name ($*) : expected output \"$expected\", got \"$output\"" >&2
+        FAILURES=$((FAILURES + 1))
+    else
+        echo "$name ($*) : ok"
+    fi
+}
+
+# Free 2, free 3 (the last table), then free 2 again
+{ alloc_three ; command 9 0 0 2 ; command 9 0 0 3 ; command 9 0 0 2 ; command 7 0 0 0 ; } > "$WORK_DIR/double_free.egb"
+
+# Free 2 then free it again while it is the head of the free list
+{ alloc_three ; command 9 0 0 2 ; command 9 0 0 2 ; command 7 0 0 0 ; } > "$WORK_DIR/double_free_head.egb"
+
+# Free 2 then read, write and load it
+{ alloc_three ; command 9 0 0 2 ; command 1 4 2 0 ; command 7 0 0 0 ; } > "$WORK_DIR/read_after_free.egb"
+{ alloc_three ; command 9 0 0 2 ; command 2 2 0 0 ; command 7 0 0 0 ; } > "$WORK_DIR/write_after_free.egb"
+{ alloc_three ; command 9 0 0 2 ; command 12 0 2 0 ; command 7 0 0 0 ; } > "$WORK_DIR/load_after_free.egb"
+
+# Free 2 and 1, then allocate again to reuse the slots and halt normally
+{ alloc_three ; command 9 0 0 2 ; command 9 0 0 1 ; command 8 0 1 7 ; command 8 0 2 7 ; command 2 2 0 7 ; command 1 4 1 0 ; command 7 0 0 0 ; } > "$WORK_DIR/reuse.egb"
+
+# Overwrite the add following an update (a stack push idiom) with an output of
+# 'X' from that same update, then output a new line and halt
+{ ortho 3 88 ; ortho 4 10 ; ortho 2 10 ; ortho 5 16777216 ; command 4 2 2 5 ; ortho 5 16 ; command 4 2 2 5 ; ortho 5 3 ; command 3 2 2 5 ; ortho 1 11 ; command 2 0 1 2 ; command 3 1 1 6 ; command 10 0 0 4 ; command 7 0 0 0 ; } > "$WORK_DIR/self_modifying.egb"
+
+for mode in "-c" "-c -a malloc" "-d" ; do
+    check double_free 2 $mode
+    check double_free_head 2 $mode
+    check read_after_free 1 $mode
+    check write_after_free 1 $mode
+    check load_after_free 1 $mode
+    check reuse 0 $mode
+done
+
+for mode in "" "-c" "-d" "-j" "-p" ; do
+    check_output self_modifying X $mode
+done
+
+rm -rf "$WORK_DIR"
+if [ $FAILURES -ne 0 ] ; then
+    echo "$FAILURES failed checks" >&2
+    exit 1
+fi
+echo "All checks passed"